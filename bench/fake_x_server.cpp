@@ -0,0 +1,1074 @@
+#include "fake_x_server.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+const xcb_window_t ROOT_WINDOW = 0x100;
+const xcb_visualid_t ROOT_VISUAL = 0x21;
+const xcb_colormap_t ROOT_COLORMAP = 0x20;
+const uint32_t RESOURCE_BASE = 0x00200000;
+const uint32_t RESOURCE_MASK = 0x001fffff;
+const xcb_window_t FOREIGN_BASE = 0x00800000;
+const xcb_atom_t FIRST_DYNAMIC_ATOM = 69; // after the predefined atoms
+
+const uint8_t MIN_KEYCODE = 8;
+const uint8_t MAX_KEYCODE = 255;
+const int KEYSYMS_PER_KEYCODE = 2;
+
+struct Key {
+  xcb_keycode_t keycode;
+  uint32_t keysym;
+};
+
+// A few keys of a PC keyboard with the usual evdev keycodes.
+const Key keymap[] = {
+    {9, 0xff1b},  {10, 0x31}, {11, 0x32}, {12, 0x33},     {13, 0x34},
+    {14, 0x35},   {15, 0x36}, {16, 0x37}, {17, 0x38},     {18, 0x39},
+    {19, 0x30},   {23, 0xff09}, {36, 0xff0d}, {50, 0xffe1}, {64, 0xffe9},
+    {67, 0xffbe}, {68, 0xffbf}, {69, 0xffc0}, {70, 0xffc1},
+};
+
+const uint8_t BAD_REQUEST = 1;
+const uint8_t BAD_VALUE = 2;
+const uint8_t BAD_WINDOW = 3;
+const uint8_t BAD_ATOM = 5;
+const uint8_t BAD_MATCH = 8;
+const uint8_t BAD_IMPLEMENTATION = 17;
+
+// The modifier a key sets while it is held, if any.
+uint16_t modifier_of(xcb_keycode_t keycode) {
+  for (const Key &key : keymap) {
+    if (key.keycode != keycode)
+      continue;
+    if (key.keysym == 0xffe1 || key.keysym == 0xffe2)
+      return XCB_MOD_MASK_SHIFT;
+    if (key.keysym == 0xffe9 || key.keysym == 0xffea)
+      return XCB_MOD_MASK_1;
+  }
+  return 0;
+}
+
+size_t pad4(size_t n) { return (n + 3) & ~size_t(3); }
+
+template <typename T> T read_at(const uint8_t *p, size_t offset) {
+  T value;
+  memcpy(&value, p + offset, sizeof(value));
+  return value;
+}
+
+} // namespace
+
+FakeXServer::FakeXServer(int width, int height)
+    : width_(width), height_(height), root_(ROOT_WINDOW),
+      next_foreign_(FOREIGN_BASE), focus_(XCB_INPUT_FOCUS_POINTER_ROOT),
+      next_atom_(FIRST_DYNAMIC_ATOM) {
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+    perror("socketpair");
+    closed_ = true;
+    return;
+  }
+  fd_ = fds[0];
+  client_fd_ = fds[1];
+  fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) | O_NONBLOCK);
+
+  Window &root = windows_[root_];
+  root.width = width;
+  root.height = height;
+  root.mapped = true;
+}
+
+FakeXServer::~FakeXServer() {
+  if (fd_ >= 0)
+    close(fd_);
+  if (client_fd_ >= 0)
+    close(client_fd_);
+}
+
+int FakeXServer::take_client_fd() {
+  int fd = client_fd_;
+  client_fd_ = -1;
+  return fd;
+}
+
+bool FakeXServer::serve() {
+  char buf[65536];
+  while (!closed_) {
+    ssize_t n = read(fd_, buf, sizeof(buf));
+    if (n > 0) {
+      in_.append(buf, n);
+    } else if (n == 0) {
+      closed_ = true;
+    } else if (errno == EAGAIN) {
+      break;
+    } else if (errno != EINTR) {
+      closed_ = true;
+    }
+  }
+
+  uint64_t replies = counts_.replies;
+  if (!setup_done_)
+    handle_setup();
+
+  size_t pos = 0;
+  while (setup_done_ && in_.size() - pos >= 4) {
+    const uint8_t *req = reinterpret_cast<const uint8_t *>(in_.data()) + pos;
+    size_t length = read_at<uint16_t>(req, 2) * 4;
+    if (length == 0) {
+      // BIG-REQUESTS form, never enabled here.
+      closed_ = true;
+      break;
+    }
+    if (in_.size() - pos < length)
+      break;
+    sequence_++;
+    counts_.requests++;
+    counts_.by_opcode[req[0]]++;
+    log_.push_back({sequence_, req[0]});
+    handle_request(req, length);
+    pos += length;
+  }
+  in_.erase(0, pos);
+
+  if (counts_.replies != replies)
+    counts_.reply_batches++;
+  flush();
+  return !closed_;
+}
+
+void FakeXServer::handle_setup() {
+  if (in_.size() < 12)
+    return;
+  const uint8_t *req = reinterpret_cast<const uint8_t *>(in_.data());
+  if (req[0] != 'l') {
+    fprintf(stderr, "fake X server: only LSB-first clients are supported\n");
+    closed_ = true;
+    return;
+  }
+  size_t size = 12 + pad4(read_at<uint16_t>(req, 6)) +
+                pad4(read_at<uint16_t>(req, 8));
+  if (in_.size() < size)
+    return;
+  in_.erase(0, size);
+
+  const char vendor[] = "fake";
+  size_t vendor_size = pad4(sizeof(vendor) - 1);
+
+  xcb_setup_t setup = {};
+  setup.status = 1;
+  setup.protocol_major_version = 11;
+  setup.protocol_minor_version = 0;
+  setup.release_number = 1;
+  setup.resource_id_base = RESOURCE_BASE;
+  setup.resource_id_mask = RESOURCE_MASK;
+  setup.vendor_len = sizeof(vendor) - 1;
+  setup.maximum_request_length = 0xffff;
+  setup.roots_len = 1;
+  setup.pixmap_formats_len = 1;
+  setup.image_byte_order = XCB_IMAGE_ORDER_LSB_FIRST;
+  setup.bitmap_format_bit_order = XCB_IMAGE_ORDER_LSB_FIRST;
+  setup.bitmap_format_scanline_unit = 32;
+  setup.bitmap_format_scanline_pad = 32;
+  setup.min_keycode = MIN_KEYCODE;
+  setup.max_keycode = MAX_KEYCODE;
+
+  xcb_format_t format = {};
+  format.depth = 24;
+  format.bits_per_pixel = 32;
+  format.scanline_pad = 32;
+
+  xcb_screen_t screen = {};
+  screen.root = root_;
+  screen.default_colormap = ROOT_COLORMAP;
+  screen.white_pixel = 0xffffff;
+  screen.black_pixel = 0;
+  screen.width_in_pixels = width_;
+  screen.height_in_pixels = height_;
+  screen.width_in_millimeters = width_ / 4;
+  screen.height_in_millimeters = height_ / 4;
+  screen.min_installed_maps = 1;
+  screen.max_installed_maps = 1;
+  screen.root_visual = ROOT_VISUAL;
+  screen.root_depth = 24;
+  screen.allowed_depths_len = 1;
+
+  xcb_depth_t depth = {};
+  depth.depth = 24;
+  depth.visuals_len = 1;
+
+  xcb_visualtype_t visual = {};
+  visual.visual_id = ROOT_VISUAL;
+  visual._class = XCB_VISUAL_CLASS_TRUE_COLOR;
+  visual.bits_per_rgb_value = 8;
+  visual.colormap_entries = 256;
+  visual.red_mask = 0xff0000;
+  visual.green_mask = 0xff00;
+  visual.blue_mask = 0xff;
+
+  std::string out(reinterpret_cast<const char *>(&setup), sizeof(setup));
+  out.append(vendor, sizeof(vendor) - 1);
+  out.resize(sizeof(setup) + vendor_size);
+  out.append(reinterpret_cast<const char *>(&format), sizeof(format));
+  out.append(reinterpret_cast<const char *>(&screen), sizeof(screen));
+  out.append(reinterpret_cast<const char *>(&depth), sizeof(depth));
+  out.append(reinterpret_cast<const char *>(&visual), sizeof(visual));
+  uint16_t length = (out.size() - 8) / 4;
+  memcpy(&out[6], &length, sizeof(length));
+
+  out_ += out;
+  setup_done_ = true;
+}
+
+void FakeXServer::handle_request(const uint8_t *req, size_t length) {
+  uint8_t opcode = req[0];
+  auto window_at = [&](size_t offset) -> Window * {
+    auto it = windows_.find(read_at<uint32_t>(req, offset));
+    if (it == windows_.end()) {
+      write_error(BAD_WINDOW, read_at<uint32_t>(req, offset), opcode);
+      return nullptr;
+    }
+    return &it->second;
+  };
+
+  switch (opcode) {
+  case XCB_CREATE_WINDOW: {
+    xcb_create_window_request_t r;
+    memcpy(&r, req, sizeof(r));
+    if (!window_at(8))
+      break;
+    create_window(r.wid, r.parent, r.x, r.y, r.width, r.height,
+                  r.border_width, r._class, false);
+    change_attributes(windows_[r.wid], r.value_mask,
+                      reinterpret_cast<const uint32_t *>(req + sizeof(r)));
+    break;
+  }
+  case XCB_CHANGE_WINDOW_ATTRIBUTES: {
+    if (Window *w = window_at(4))
+      change_attributes(*w, read_at<uint32_t>(req, 8),
+                        reinterpret_cast<const uint32_t *>(req + 12));
+    break;
+  }
+  case XCB_GET_WINDOW_ATTRIBUTES: {
+    Window *w = window_at(4);
+    if (!w)
+      break;
+    xcb_get_window_attributes_reply_t reply = {};
+    reply.response_type = 1;
+    reply.backing_store = XCB_BACKING_STORE_NOT_USEFUL;
+    reply.visual = ROOT_VISUAL;
+    reply._class = w->window_class;
+    reply.map_state = !w->mapped    ? XCB_MAP_STATE_UNMAPPED
+                      : viewable(*w) ? XCB_MAP_STATE_VIEWABLE
+                                     : XCB_MAP_STATE_UNVIEWABLE;
+    reply.override_redirect = w->override_redirect;
+    reply.colormap = ROOT_COLORMAP;
+    reply.all_event_masks = w->event_mask;
+    reply.your_event_mask = w->event_mask;
+    write_reply(&reply, sizeof(reply));
+    break;
+  }
+  case XCB_DESTROY_WINDOW:
+    if (window_at(4))
+      destroy_window(read_at<uint32_t>(req, 4));
+    break;
+  case XCB_REPARENT_WINDOW:
+    if (window_at(4) && window_at(8))
+      reparent_window(read_at<uint32_t>(req, 4), read_at<uint32_t>(req, 8),
+                      read_at<int16_t>(req, 12), read_at<int16_t>(req, 14));
+    break;
+  case XCB_MAP_WINDOW:
+    if (window_at(4))
+      map_window(read_at<uint32_t>(req, 4), true);
+    break;
+  case XCB_UNMAP_WINDOW:
+    if (window_at(4))
+      unmap_window(read_at<uint32_t>(req, 4));
+    break;
+  case XCB_CONFIGURE_WINDOW:
+    if (window_at(4))
+      configure_window(read_at<uint32_t>(req, 4), read_at<uint16_t>(req, 8),
+                       reinterpret_cast<const uint32_t *>(req + 12), true);
+    break;
+  case XCB_GET_GEOMETRY: {
+    Window *w = window_at(4);
+    if (!w)
+      break;
+    xcb_get_geometry_reply_t reply = {};
+    reply.response_type = 1;
+    reply.depth = 24;
+    reply.root = root_;
+    reply.x = w->x;
+    reply.y = w->y;
+    reply.width = w->width;
+    reply.height = w->height;
+    reply.border_width = w->border_width;
+    write_reply(&reply, sizeof(reply));
+    break;
+  }
+  case XCB_QUERY_TREE: {
+    Window *w = window_at(4);
+    if (!w)
+      break;
+    xcb_query_tree_reply_t reply = {};
+    reply.response_type = 1;
+    reply.root = root_;
+    reply.parent = w->parent;
+    reply.children_len = w->children.size();
+    write_reply(&reply, sizeof(reply), w->children.data(),
+                w->children.size() * 4);
+    break;
+  }
+  case XCB_INTERN_ATOM: {
+    std::string name(reinterpret_cast<const char *>(req + 8),
+                     read_at<uint16_t>(req, 4));
+    xcb_intern_atom_reply_t reply = {};
+    reply.response_type = 1;
+    auto it = atoms_.find(name);
+    if (it != atoms_.end())
+      reply.atom = it->second;
+    else if (!req[1]) // only_if_exists
+      reply.atom = atom(name);
+    write_reply(&reply, sizeof(reply));
+    break;
+  }
+  case XCB_CHANGE_PROPERTY: {
+    xcb_change_property_request_t r;
+    memcpy(&r, req, sizeof(r));
+    if (!window_at(4))
+      break;
+    if (r.format != 8 && r.format != 16 && r.format != 32) {
+      write_error(BAD_VALUE, r.format, opcode);
+      break;
+    }
+    size_t size = static_cast<size_t>(r.data_len) * (r.format / 8);
+    if (sizeof(r) + size > length) {
+      write_error(BAD_REQUEST, 0, opcode);
+      break;
+    }
+    std::string data(reinterpret_cast<const char *>(req + sizeof(r)), size);
+    if (!change_property(r.window, r.mode, r.property, r.type, r.format,
+                         data))
+      write_error(BAD_MATCH, r.property, opcode);
+    break;
+  }
+  case XCB_DELETE_PROPERTY:
+    if (window_at(4))
+      delete_property(read_at<uint32_t>(req, 4), read_at<uint32_t>(req, 8));
+    break;
+  case XCB_GET_PROPERTY: {
+    xcb_get_property_request_t r;
+    memcpy(&r, req, sizeof(r));
+    Window *w = window_at(4);
+    if (!w)
+      break;
+    if (r.property == XCB_ATOM_NONE) {
+      write_error(BAD_ATOM, r.property, opcode);
+      break;
+    }
+    xcb_get_property_reply_t reply = {};
+    reply.response_type = 1;
+    auto it = w->properties.find(r.property);
+    if (it == w->properties.end()) {
+      write_reply(&reply, sizeof(reply));
+      break;
+    }
+    const Property &p = it->second;
+    reply.format = p.format;
+    reply.type = p.type;
+    if (r.type != XCB_GET_PROPERTY_TYPE_ANY && r.type != p.type) {
+      reply.bytes_after = p.data.size();
+      write_reply(&reply, sizeof(reply));
+      break;
+    }
+    size_t offset = static_cast<size_t>(r.long_offset) * 4;
+    if (offset > p.data.size()) {
+      write_error(BAD_VALUE, r.long_offset, opcode);
+      break;
+    }
+    size_t size = std::min(p.data.size() - offset,
+                           static_cast<size_t>(r.long_length) * 4);
+    reply.bytes_after = p.data.size() - offset - size;
+    reply.value_len = size / (p.format / 8);
+    std::string value = p.data.substr(offset, size);
+    write_reply(&reply, sizeof(reply), value.data(), value.size());
+    if (r._delete && reply.bytes_after == 0)
+      delete_property(r.window, r.property);
+    break;
+  }
+  case XCB_SEND_EVENT:
+    if (window_at(4))
+      send_event(read_at<uint32_t>(req, 4), req + 12);
+    break;
+  case XCB_GRAB_BUTTON:
+  case XCB_GRAB_KEY:
+    window_at(4);
+    break;
+  case XCB_UNGRAB_BUTTON:
+  case XCB_UNGRAB_KEY:
+  case XCB_CHANGE_SAVE_SET:
+    window_at(4);
+    break;
+  case XCB_GRAB_KEYBOARD: {
+    // Every key event already goes to the WM.
+    if (!window_at(4))
+      break;
+    xcb_grab_keyboard_reply_t reply = {};
+    reply.response_type = 1;
+    reply.status = XCB_GRAB_STATUS_SUCCESS;
+    write_reply(&reply, sizeof(reply));
+    break;
+  }
+  case XCB_QUERY_POINTER: {
+    if (!window_at(4))
+      break;
+    xcb_query_pointer_reply_t reply = {};
+    reply.response_type = 1;
+    reply.same_screen = 1;
+    reply.root = root_;
+    reply.root_x = pointer_x_;
+    reply.root_y = pointer_y_;
+    int x, y;
+    root_origin(read_at<uint32_t>(req, 4), x, y);
+    reply.win_x = pointer_x_ - x;
+    reply.win_y = pointer_y_ - y;
+    reply.mask = modifiers_;
+    write_reply(&reply, sizeof(reply));
+    break;
+  }
+  case XCB_SET_INPUT_FOCUS: {
+    xcb_window_t window = read_at<uint32_t>(req, 4);
+    if (window == XCB_NONE || window == XCB_INPUT_FOCUS_POINTER_ROOT ||
+        window_at(4))
+      focus_ = window;
+    break;
+  }
+  case XCB_GET_INPUT_FOCUS: {
+    xcb_get_input_focus_reply_t reply = {};
+    reply.response_type = 1;
+    reply.revert_to = XCB_INPUT_FOCUS_POINTER_ROOT;
+    reply.focus = focus_;
+    write_reply(&reply, sizeof(reply));
+    break;
+  }
+  case XCB_QUERY_EXTENSION: {
+    xcb_query_extension_reply_t reply = {};
+    reply.response_type = 1;
+    write_reply(&reply, sizeof(reply));
+    break;
+  }
+  case XCB_GET_KEYBOARD_MAPPING: {
+    uint8_t first = req[4];
+    uint8_t count = req[5];
+    if (first < MIN_KEYCODE || first + count - 1 > MAX_KEYCODE) {
+      write_error(BAD_VALUE, first, opcode);
+      break;
+    }
+    std::vector<uint32_t> keysyms(count * KEYSYMS_PER_KEYCODE, 0);
+    for (const Key &key : keymap) {
+      if (key.keycode >= first && key.keycode < first + count)
+        keysyms[(key.keycode - first) * KEYSYMS_PER_KEYCODE] = key.keysym;
+    }
+    xcb_get_keyboard_mapping_reply_t reply = {};
+    reply.response_type = 1;
+    reply.keysyms_per_keycode = KEYSYMS_PER_KEYCODE;
+    write_reply(&reply, sizeof(reply), keysyms.data(), keysyms.size() * 4);
+    break;
+  }
+  case XCB_KILL_CLIENT: {
+    // Simulated applications own one window each.
+    xcb_window_t window = read_at<uint32_t>(req, 4);
+    auto it = windows_.find(window);
+    if (it != windows_.end() && it->second.foreign)
+      destroy_window(window);
+    else if (window != XCB_KILL_ALL_TEMPORARY && it == windows_.end())
+      write_error(BAD_VALUE, window, opcode);
+    break;
+  }
+  // Accepted without an effect anything here depends on.
+  case XCB_GRAB_SERVER:
+  case XCB_UNGRAB_SERVER:
+  case XCB_UNGRAB_KEYBOARD:
+  case XCB_OPEN_FONT:
+  case XCB_CLOSE_FONT:
+  case XCB_CREATE_PIXMAP:
+  case XCB_FREE_PIXMAP:
+  case XCB_CREATE_GC:
+  case XCB_CHANGE_GC:
+  case XCB_FREE_GC:
+  case XCB_COPY_AREA:
+  case XCB_POLY_FILL_RECTANGLE:
+  case XCB_IMAGE_TEXT_8:
+  case XCB_CREATE_GLYPH_CURSOR:
+  case XCB_FREE_CURSOR:
+  case XCB_SET_CLOSE_DOWN_MODE:
+  case XCB_NO_OPERATION:
+    break;
+  default:
+    write_error(BAD_IMPLEMENTATION, 0, opcode);
+    break;
+  }
+}
+
+void FakeXServer::create_window(xcb_window_t id, xcb_window_t parent, int x,
+                                int y, int width, int height,
+                                int border_width, uint16_t window_class,
+                                bool foreign) {
+  Window &w = windows_[id];
+  w.parent = parent;
+  w.x = x;
+  w.y = y;
+  w.width = width;
+  w.height = height;
+  w.border_width = border_width;
+  w.window_class = window_class == XCB_WINDOW_CLASS_COPY_FROM_PARENT
+                       ? windows_[parent].window_class
+                       : window_class;
+  w.foreign = foreign;
+  windows_[parent].children.push_back(id);
+
+  xcb_create_notify_event_t e = {};
+  e.response_type = XCB_CREATE_NOTIFY;
+  e.parent = parent;
+  e.window = id;
+  e.x = x;
+  e.y = y;
+  e.width = width;
+  e.height = height;
+  e.border_width = border_width;
+  write_event_if(parent, XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY, &e);
+}
+
+void FakeXServer::change_attributes(Window &w, uint32_t value_mask,
+                                    const uint32_t *values) {
+  for (uint32_t bit = 1; bit && bit <= XCB_CW_CURSOR; bit <<= 1) {
+    if (!(value_mask & bit))
+      continue;
+    uint32_t value = *values++;
+    if (bit == XCB_CW_EVENT_MASK)
+      w.event_mask = value;
+    else if (bit == XCB_CW_OVERRIDE_REDIRECT)
+      w.override_redirect = value;
+  }
+}
+
+void FakeXServer::map_window(xcb_window_t window, bool from_wm) {
+  Window &w = windows_[window];
+  if (w.mapped)
+    return;
+
+  const Window &parent = windows_[w.parent];
+  if (!from_wm && !w.override_redirect &&
+      (parent.event_mask & XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT)) {
+    xcb_map_request_event_t e = {};
+    e.response_type = XCB_MAP_REQUEST;
+    e.parent = w.parent;
+    e.window = window;
+    write_event(&e);
+    return;
+  }
+
+  w.mapped = true;
+  xcb_map_notify_event_t e = {};
+  e.response_type = XCB_MAP_NOTIFY;
+  e.window = window;
+  e.override_redirect = w.override_redirect;
+  notify(window, &e);
+  if (viewable(w))
+    expose_tree(window);
+}
+
+void FakeXServer::unmap_window(xcb_window_t window) {
+  Window &w = windows_[window];
+  if (!w.mapped)
+    return;
+  w.mapped = false;
+
+  xcb_unmap_notify_event_t e = {};
+  e.response_type = XCB_UNMAP_NOTIFY;
+  e.window = window;
+  notify(window, &e);
+}
+
+void FakeXServer::destroy_window(xcb_window_t window) {
+  if (window == root_)
+    return;
+  unmap_window(window);
+
+  // Inferiors first, as the server reports them.
+  std::vector<xcb_window_t> children = windows_[window].children;
+  for (xcb_window_t child : children)
+    destroy_window(child);
+
+  xcb_destroy_notify_event_t e = {};
+  e.response_type = XCB_DESTROY_NOTIFY;
+  e.window = window;
+  notify(window, &e);
+
+  Window &parent = windows_[windows_[window].parent];
+  parent.children.erase(
+      std::find(parent.children.begin(), parent.children.end(), window));
+  windows_.erase(window);
+  if (focus_ == window)
+    focus_ = XCB_INPUT_FOCUS_POINTER_ROOT;
+}
+
+void FakeXServer::reparent_window(xcb_window_t window, xcb_window_t parent,
+                                  int x, int y) {
+  Window &w = windows_[window];
+  bool was_mapped = w.mapped;
+  unmap_window(window);
+
+  xcb_window_t old_parent = w.parent;
+  std::vector<xcb_window_t> &siblings = windows_[old_parent].children;
+  siblings.erase(std::find(siblings.begin(), siblings.end(), window));
+  windows_[parent].children.push_back(window);
+  w.parent = parent;
+  w.x = x;
+  w.y = y;
+
+  xcb_reparent_notify_event_t e = {};
+  e.response_type = XCB_REPARENT_NOTIFY;
+  e.window = window;
+  e.parent = parent;
+  e.x = x;
+  e.y = y;
+  e.override_redirect = w.override_redirect;
+  e.event = window;
+  write_event_if(window, XCB_EVENT_MASK_STRUCTURE_NOTIFY, &e);
+  e.event = old_parent;
+  write_event_if(old_parent, XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY, &e);
+  e.event = parent;
+  write_event_if(parent, XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY, &e);
+
+  if (was_mapped)
+    map_window(window, true);
+}
+
+void FakeXServer::configure_window(xcb_window_t window, uint16_t value_mask,
+                                   const uint32_t *values, bool from_wm) {
+  Window &w = windows_[window];
+  int x = w.x, y = w.y, width = w.width, height = w.height;
+  int border_width = w.border_width;
+  xcb_window_t sibling = XCB_NONE;
+  uint8_t stack_mode = XCB_STACK_MODE_ABOVE;
+  if (value_mask & XCB_CONFIG_WINDOW_X)
+    x = static_cast<int32_t>(*values++);
+  if (value_mask & XCB_CONFIG_WINDOW_Y)
+    y = static_cast<int32_t>(*values++);
+  if (value_mask & XCB_CONFIG_WINDOW_WIDTH)
+    width = *values++;
+  if (value_mask & XCB_CONFIG_WINDOW_HEIGHT)
+    height = *values++;
+  if (value_mask & XCB_CONFIG_WINDOW_BORDER_WIDTH)
+    border_width = *values++;
+  if (value_mask & XCB_CONFIG_WINDOW_SIBLING)
+    sibling = *values++;
+  if (value_mask & XCB_CONFIG_WINDOW_STACK_MODE)
+    stack_mode = *values++;
+
+  const Window &parent = windows_[w.parent];
+  if (!from_wm && !w.override_redirect &&
+      (parent.event_mask & XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT)) {
+    xcb_configure_request_event_t e = {};
+    e.response_type = XCB_CONFIGURE_REQUEST;
+    e.stack_mode = stack_mode;
+    e.parent = w.parent;
+    e.window = window;
+    e.sibling = sibling;
+    e.x = x;
+    e.y = y;
+    e.width = width;
+    e.height = height;
+    e.border_width = border_width;
+    e.value_mask = value_mask;
+    write_event(&e);
+    return;
+  }
+
+  w.x = x;
+  w.y = y;
+  w.width = width;
+  w.height = height;
+  w.border_width = border_width;
+
+  if (value_mask & XCB_CONFIG_WINDOW_STACK_MODE) {
+    std::vector<xcb_window_t> &siblings = windows_[w.parent].children;
+    siblings.erase(std::find(siblings.begin(), siblings.end(), window));
+    auto at = std::find(siblings.begin(), siblings.end(), sibling);
+    if (stack_mode == XCB_STACK_MODE_BELOW)
+      siblings.insert(at == siblings.end() ? siblings.begin() : at, window);
+    else
+      siblings.insert(at == siblings.end() ? siblings.end() : at + 1, window);
+  }
+
+  xcb_configure_notify_event_t e = {};
+  e.response_type = XCB_CONFIGURE_NOTIFY;
+  e.window = window;
+  e.above_sibling = below(windows_[w.parent], window);
+  e.x = x;
+  e.y = y;
+  e.width = width;
+  e.height = height;
+  e.border_width = border_width;
+  e.override_redirect = w.override_redirect;
+  notify(window, &e);
+}
+
+bool FakeXServer::change_property(xcb_window_t window, uint8_t mode,
+                                  xcb_atom_t atom, xcb_atom_t type,
+                                  uint8_t format, const std::string &data) {
+  Window &w = windows_[window];
+  auto it = w.properties.find(atom);
+  if (mode == XCB_PROP_MODE_REPLACE || it == w.properties.end()) {
+    w.properties[atom] = {type, format, data};
+  } else {
+    Property &p = it->second;
+    if (p.type != type || p.format != format)
+      return false;
+    if (mode == XCB_PROP_MODE_APPEND)
+      p.data += data;
+    else
+      p.data.insert(0, data);
+  }
+
+  xcb_property_notify_event_t e = {};
+  e.response_type = XCB_PROPERTY_NOTIFY;
+  e.window = window;
+  e.atom = atom;
+  e.time = time_;
+  e.state = XCB_PROPERTY_NEW_VALUE;
+  write_event_if(window, XCB_EVENT_MASK_PROPERTY_CHANGE, &e);
+  return true;
+}
+
+void FakeXServer::delete_property(xcb_window_t window, xcb_atom_t atom) {
+  Window &w = windows_[window];
+  if (!w.properties.erase(atom))
+    return;
+
+  xcb_property_notify_event_t e = {};
+  e.response_type = XCB_PROPERTY_NOTIFY;
+  e.window = window;
+  e.atom = atom;
+  e.time = time_;
+  e.state = XCB_PROPERTY_DELETE;
+  write_event_if(window, XCB_EVENT_MASK_PROPERTY_CHANGE, &e);
+}
+
+// Only what simulated applications react to: a WM_DELETE_WINDOW message.
+void FakeXServer::send_event(xcb_window_t destination, const uint8_t *event) {
+  Window &w = windows_[destination];
+  if (!w.foreign || (event[0] & 0x7f) != XCB_CLIENT_MESSAGE)
+    return;
+  xcb_client_message_event_t e;
+  memcpy(&e, event, sizeof(e));
+  if (e.format == 32 && e.type == atom("WM_PROTOCOLS") &&
+      e.data.data32[0] == atom("WM_DELETE_WINDOW") && w.closes_on_delete)
+    destroy_window(destination);
+}
+
+bool FakeXServer::viewable(const Window &w) const {
+  const Window *at = &w;
+  while (at->mapped) {
+    if (at->parent == XCB_NONE)
+      return true;
+    at = &windows_.at(at->parent);
+  }
+  return false;
+}
+
+void FakeXServer::expose_tree(xcb_window_t window) {
+  const Window &w = windows_[window];
+  if (!w.mapped)
+    return;
+  if (w.window_class == XCB_WINDOW_CLASS_INPUT_OUTPUT) {
+    xcb_expose_event_t e = {};
+    e.response_type = XCB_EXPOSE;
+    e.window = window;
+    e.width = w.width;
+    e.height = w.height;
+    write_event_if(window, XCB_EVENT_MASK_EXPOSURE, &e);
+  }
+  for (xcb_window_t child : w.children)
+    expose_tree(child);
+}
+
+// The root coordinates of window's inside top-left corner.
+void FakeXServer::root_origin(xcb_window_t window, int &x, int &y) const {
+  x = y = 0;
+  for (auto it = windows_.find(window);
+       it != windows_.end() && it->second.parent != XCB_NONE;
+       it = windows_.find(it->second.parent)) {
+    x += it->second.x + it->second.border_width;
+    y += it->second.y + it->second.border_width;
+  }
+}
+
+// The sibling directly below window, as reported in ConfigureNotify.
+xcb_window_t FakeXServer::below(const Window &parent,
+                                xcb_window_t window) const {
+  auto it = std::find(parent.children.begin(), parent.children.end(), window);
+  return it == parent.children.begin() || it == parent.children.end()
+             ? XCB_NONE
+             : *(it - 1);
+}
+
+void FakeXServer::write_event(const void *event) {
+  char e[32];
+  memcpy(e, event, sizeof(e));
+  memcpy(e + 2, &sequence_, sizeof(sequence_));
+  out_.append(e, sizeof(e));
+  counts_.events++;
+}
+
+void FakeXServer::write_event_if(xcb_window_t window, uint32_t mask,
+                                 const void *event) {
+  auto it = windows_.find(window);
+  if (it != windows_.end() && (it->second.event_mask & mask))
+    write_event(event);
+}
+
+// Structure events (ConfigureNotify, MapNotify, ...) go to the window for
+// StructureNotify and to its parent for SubstructureNotify, with the
+// receiving window in the event field at offset 4.
+void FakeXServer::notify(xcb_window_t window, void *event) {
+  uint8_t *e = static_cast<uint8_t *>(event);
+  memcpy(e + 4, &window, 4);
+  write_event_if(window, XCB_EVENT_MASK_STRUCTURE_NOTIFY, e);
+
+  auto it = windows_.find(window);
+  if (it == windows_.end() || it->second.parent == XCB_NONE)
+    return;
+  xcb_window_t parent = it->second.parent;
+  memcpy(e + 4, &parent, 4);
+  write_event_if(parent, XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY, e);
+}
+
+void FakeXServer::write_reply(void *reply, size_t size, const void *extra,
+                              size_t extra_size) {
+  // Reply structs only declare the fields in use, but every reply is at
+  // least 32 bytes on the wire.
+  uint8_t *r = static_cast<uint8_t *>(reply);
+  size_t fixed = std::max<size_t>(size, 32);
+  uint32_t length = (fixed + pad4(extra_size) - 32) / 4;
+  memcpy(r + 2, &sequence_, sizeof(sequence_));
+  memcpy(r + 4, &length, sizeof(length));
+  out_.append(reinterpret_cast<const char *>(r), size);
+  out_.append(fixed - size, '\0');
+  if (extra_size)
+    out_.append(static_cast<const char *>(extra), extra_size);
+  out_.append(pad4(extra_size) - extra_size, '\0');
+  counts_.replies++;
+}
+
+void FakeXServer::write_error(uint8_t code, uint32_t resource, uint8_t major) {
+  xcb_generic_error_t e = {};
+  e.response_type = 0;
+  e.error_code = code;
+  e.sequence = sequence_;
+  e.resource_id = resource;
+  e.major_code = major;
+  out_.append(reinterpret_cast<const char *>(&e), 32);
+  counts_.errors++;
+}
+
+void FakeXServer::flush() {
+  while (out_pos_ < out_.size()) {
+    ssize_t n = write(fd_, out_.data() + out_pos_, out_.size() - out_pos_);
+    if (n > 0) {
+      out_pos_ += n;
+    } else if (n < 0 && errno == EINTR) {
+      continue;
+    } else {
+      if (n < 0 && errno != EAGAIN)
+        closed_ = true;
+      break;
+    }
+  }
+  if (out_pos_ == out_.size()) {
+    out_.clear();
+    out_pos_ = 0;
+  }
+}
+
+xcb_window_t FakeXServer::create_client(int width, int height,
+                                        const std::string &title,
+                                        bool supports_delete) {
+  xcb_window_t window = next_foreign_++;
+  create_window(window, root_, 0, 0, width, height, 0,
+                XCB_WINDOW_CLASS_INPUT_OUTPUT, true);
+  windows_[window].closes_on_delete = supports_delete;
+  set_title(window, title);
+  if (supports_delete) {
+    xcb_atom_t protocols = atom("WM_DELETE_WINDOW");
+    change_property(window, XCB_PROP_MODE_REPLACE, atom("WM_PROTOCOLS"),
+                    XCB_ATOM_ATOM, 32,
+                    std::string(reinterpret_cast<const char *>(&protocols),
+                                sizeof(protocols)));
+  }
+  flush();
+  return window;
+}
+
+void FakeXServer::map(xcb_window_t window) {
+  if (!exists(window))
+    return;
+  map_window(window, false);
+  flush();
+}
+
+void FakeXServer::set_title(xcb_window_t window, const std::string &title) {
+  if (!exists(window))
+    return;
+  change_property(window, XCB_PROP_MODE_REPLACE, XCB_ATOM_WM_NAME,
+                  XCB_ATOM_STRING, 8, title);
+  flush();
+}
+
+void FakeXServer::destroy(xcb_window_t window) {
+  if (!exists(window))
+    return;
+  destroy_window(window);
+  flush();
+}
+
+void FakeXServer::unmap(xcb_window_t window) {
+  if (!exists(window))
+    return;
+  unmap_window(window);
+  flush();
+}
+
+void FakeXServer::inject(const void *event) {
+  track_input(static_cast<const uint8_t *>(event));
+  write_event(event);
+  flush();
+}
+
+// Input events carry the pointer position and the modifiers held before
+// them, which QueryPointer reports as they are after the event.
+void FakeXServer::track_input(const uint8_t *e) {
+  uint8_t type = e[0] & 0x7f;
+  if (type < XCB_KEY_PRESS || type > XCB_LEAVE_NOTIFY)
+    return;
+  pointer_x_ = read_at<int16_t>(e, 20);
+  pointer_y_ = read_at<int16_t>(e, 22);
+  modifiers_ = read_at<uint16_t>(e, 28);
+  if (type == XCB_KEY_PRESS)
+    modifiers_ |= modifier_of(e[1]);
+  else if (type == XCB_KEY_RELEASE)
+    modifiers_ &= ~modifier_of(e[1]);
+}
+
+void FakeXServer::input_event(uint8_t type, uint8_t detail,
+                              xcb_window_t window, int root_x, int root_y,
+                              uint16_t state) {
+  int x, y;
+  root_origin(window, x, y);
+
+  xcb_button_press_event_t e = {};
+  e.response_type = type;
+  e.detail = detail;
+  e.time = time_++;
+  e.root = root_;
+  e.event = window;
+  e.root_x = root_x;
+  e.root_y = root_y;
+  e.event_x = root_x - x;
+  e.event_y = root_y - y;
+  e.state = state;
+  e.same_screen = 1;
+  track_input(reinterpret_cast<const uint8_t *>(&e));
+  write_event(&e);
+  flush();
+}
+
+void FakeXServer::button_press(xcb_window_t window, uint8_t button,
+                               int root_x, int root_y, uint16_t state) {
+  input_event(XCB_BUTTON_PRESS, button, window, root_x, root_y, state);
+}
+
+void FakeXServer::button_release(xcb_window_t window, uint8_t button,
+                                 int root_x, int root_y, uint16_t state) {
+  input_event(XCB_BUTTON_RELEASE, button, window, root_x, root_y, state);
+}
+
+void FakeXServer::motion(xcb_window_t window, int root_x, int root_y,
+                         uint16_t state) {
+  input_event(XCB_MOTION_NOTIFY, XCB_MOTION_NORMAL, window, root_x, root_y,
+              state);
+}
+
+void FakeXServer::key_press(xcb_keycode_t keycode, uint16_t state) {
+  input_event(XCB_KEY_PRESS, keycode, root_, pointer_x_, pointer_y_, state);
+}
+
+void FakeXServer::key_release(xcb_keycode_t keycode, uint16_t state) {
+  input_event(XCB_KEY_RELEASE, keycode, root_, pointer_x_, pointer_y_, state);
+}
+
+xcb_keycode_t FakeXServer::keycode_of(uint32_t keysym) const {
+  for (const Key &key : keymap) {
+    if (key.keysym == keysym)
+      return key.keycode;
+  }
+  return 0;
+}
+
+bool FakeXServer::exists(xcb_window_t window) const {
+  return windows_.count(window) != 0;
+}
+
+bool FakeXServer::is_mapped(xcb_window_t window) const {
+  auto it = windows_.find(window);
+  return it != windows_.end() && it->second.mapped;
+}
+
+xcb_window_t FakeXServer::parent_of(xcb_window_t window) const {
+  auto it = windows_.find(window);
+  return it != windows_.end() ? it->second.parent : XCB_NONE;
+}
+
+std::vector<xcb_window_t>
+FakeXServer::children_of(xcb_window_t window) const {
+  auto it = windows_.find(window);
+  return it != windows_.end() ? it->second.children
+                              : std::vector<xcb_window_t>();
+}
+
+xcb_rectangle_t FakeXServer::geometry(xcb_window_t window) const {
+  auto it = windows_.find(window);
+  if (it == windows_.end())
+    return {0, 0, 0, 0};
+  const Window &w = it->second;
+  return {w.x, w.y, w.width, w.height};
+}
+
+std::string FakeXServer::property(xcb_window_t window,
+                                  xcb_atom_t atom) const {
+  auto it = windows_.find(window);
+  if (it == windows_.end())
+    return "";
+  auto prop = it->second.properties.find(atom);
+  return prop != it->second.properties.end() ? prop->second.data : "";
+}
+
+xcb_atom_t FakeXServer::atom(const std::string &name) {
+  auto it = atoms_.find(name);
+  if (it != atoms_.end())
+    return it->second;
+  atoms_[name] = next_atom_;
+  return next_atom_++;
+}
+
+void FakeXServer::reset_counts() {
+  counts_ = Counts();
+  log_.clear();
+}
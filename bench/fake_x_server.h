@@ -0,0 +1,188 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <xcb/xcb.h>
+
+// An X server for benchmarks, run by the benchmark itself. It speaks the
+// core protocol to a single client over one end of a socketpair; the WM
+// connects through the other end (XConnection(fd), or --x-fd). It keeps
+// the window tree, properties, event selections and focus, answers the
+// requests that have replies, and sends the events a real server would
+// for what the WM does, including errors for windows that no longer exist.
+// Extensions are reported absent.
+//
+// Other applications are simulated: create_client() and the calls below it
+// act the way a program's requests would, so the WM sees MapRequests,
+// PropertyNotifys and DestroyNotifys from a window it does not own.
+//
+// Everything the WM sends is logged and counted, so the requests an
+// operation costs are exact and the same on every run.
+class FakeXServer {
+public:
+  struct Counts {
+    uint64_t requests = 0;
+    uint64_t replies = 0;
+    // serve() calls that sent at least one reply: an upper bound on how
+    // often the WM had to wait for the server.
+    uint64_t reply_batches = 0;
+    uint64_t events = 0;
+    uint64_t errors = 0;
+    uint64_t by_opcode[256] = {};
+  };
+
+  struct LoggedRequest {
+    uint16_t sequence;
+    uint8_t opcode;
+  };
+
+  FakeXServer(int width, int height);
+  ~FakeXServer();
+
+  FakeXServer(const FakeXServer &) = delete;
+  FakeXServer &operator=(const FakeXServer &) = delete;
+
+  // The WM's end of the connection. The caller owns it.
+  int take_client_fd();
+
+  // The server's end, to poll; it is nonblocking. Poll for POLLOUT as well
+  // while wants_write().
+  int fd() const { return fd_; }
+  bool wants_write() const { return out_pos_ < out_.size(); }
+
+  // Handles every complete request that has arrived and writes as much of
+  // the output as the socket takes. Returns false once the WM is gone.
+  bool serve();
+
+  // Simulated applications. A client created with supports_delete lists
+  // WM_DELETE_WINDOW and destroys its window when sent one.
+  xcb_window_t create_client(int width, int height, const std::string &title,
+                             bool supports_delete = true);
+  void map(xcb_window_t window);
+  void set_title(xcb_window_t window, const std::string &title);
+  void destroy(xcb_window_t window);
+  void unmap(xcb_window_t window);
+
+  // Sends a 32-byte event as is, for replaying recorded ones. Input events
+  // move the pointer.
+  void inject(const void *event);
+
+  // Input, delivered to window as if it had selected or grabbed it.
+  void button_press(xcb_window_t window, uint8_t button, int root_x,
+                    int root_y, uint16_t state = 0);
+  void button_release(xcb_window_t window, uint8_t button, int root_x,
+                      int root_y, uint16_t state = XCB_BUTTON_MASK_1);
+  void motion(xcb_window_t window, int root_x, int root_y,
+              uint16_t state = XCB_BUTTON_MASK_1);
+  void key_press(xcb_keycode_t keycode, uint16_t state);
+  void key_release(xcb_keycode_t keycode, uint16_t state);
+
+  // The keycode the fake keyboard has for keysym, 0 if none.
+  xcb_keycode_t keycode_of(uint32_t keysym) const;
+
+  xcb_window_t root() const { return root_; }
+  bool exists(xcb_window_t window) const;
+  bool is_mapped(xcb_window_t window) const;
+  xcb_window_t parent_of(xcb_window_t window) const;
+  // Bottom to top.
+  std::vector<xcb_window_t> children_of(xcb_window_t window) const;
+  // x and y are the outer corner within the parent.
+  xcb_rectangle_t geometry(xcb_window_t window) const;
+  xcb_window_t focus() const { return focus_; }
+  std::string property(xcb_window_t window, xcb_atom_t atom) const;
+  xcb_atom_t atom(const std::string &name);
+
+  const Counts &counts() const { return counts_; }
+  const std::vector<LoggedRequest> &log() const { return log_; }
+  void reset_counts();
+
+private:
+  struct Property {
+    xcb_atom_t type;
+    uint8_t format;
+    std::string data;
+  };
+
+  struct Window {
+    xcb_window_t parent = XCB_NONE;
+    int16_t x = 0, y = 0;
+    uint16_t width = 1, height = 1;
+    uint16_t border_width = 0;
+    uint16_t window_class = XCB_WINDOW_CLASS_INPUT_OUTPUT;
+    bool mapped = false;
+    bool override_redirect = false;
+    uint32_t event_mask = 0; // the WM's selection
+    bool foreign = false;    // belongs to a simulated application
+    bool closes_on_delete = false;
+    std::vector<xcb_window_t> children; // bottom to top
+    std::map<xcb_atom_t, Property> properties;
+  };
+
+  void handle_setup();
+  void handle_request(const uint8_t *req, size_t length);
+
+  // The requests that do something here, shared by the WM and the
+  // simulated applications (from_wm false).
+  void create_window(xcb_window_t id, xcb_window_t parent, int x, int y,
+                     int width, int height, int border_width,
+                     uint16_t window_class, bool foreign);
+  void change_attributes(Window &w, uint32_t value_mask,
+                         const uint32_t *values);
+  void map_window(xcb_window_t window, bool from_wm);
+  void unmap_window(xcb_window_t window);
+  void destroy_window(xcb_window_t window);
+  void reparent_window(xcb_window_t window, xcb_window_t parent, int x,
+                       int y);
+  void configure_window(xcb_window_t window, uint16_t value_mask,
+                        const uint32_t *values, bool from_wm);
+  bool change_property(xcb_window_t window, uint8_t mode, xcb_atom_t atom,
+                       xcb_atom_t type, uint8_t format,
+                       const std::string &data);
+  void delete_property(xcb_window_t window, xcb_atom_t atom);
+  void send_event(xcb_window_t destination, const uint8_t *event);
+
+  bool viewable(const Window &w) const;
+  void expose_tree(xcb_window_t window);
+  void root_origin(xcb_window_t window, int &x, int &y) const;
+  xcb_window_t below(const Window &w, xcb_window_t window) const;
+
+  // Output to the WM. Events and errors are 32 bytes; replies are 32 bytes
+  // plus extra, with the length field filled in here.
+  void write_event(const void *event);
+  void write_event_if(xcb_window_t window, uint32_t mask, const void *event);
+  void notify(xcb_window_t window, void *event);
+  void write_reply(void *reply, size_t size, const void *extra = nullptr,
+                   size_t extra_size = 0);
+  void write_error(uint8_t code, uint32_t resource, uint8_t major);
+  void flush();
+  void input_event(uint8_t type, uint8_t detail, xcb_window_t window,
+                   int root_x, int root_y, uint16_t state);
+  void track_input(const uint8_t *event);
+
+  int fd_ = -1;
+  int client_fd_ = -1;
+  bool closed_ = false;
+  bool setup_done_ = false;
+  std::string in_;
+  std::string out_;
+  size_t out_pos_ = 0;
+  uint16_t sequence_ = 0;
+  uint32_t time_ = 1;
+
+  int width_, height_;
+  xcb_window_t root_;
+  std::unordered_map<xcb_window_t, Window> windows_;
+  xcb_window_t next_foreign_;
+  xcb_window_t focus_;
+  int pointer_x_ = 0, pointer_y_ = 0;
+  uint16_t modifiers_ = 0; // held after the last input event
+
+  std::unordered_map<std::string, xcb_atom_t> atoms_;
+  xcb_atom_t next_atom_;
+
+  Counts counts_;
+  std::vector<LoggedRequest> log_;
+};
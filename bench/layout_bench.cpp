@@ -0,0 +1,59 @@
+// Map/unmap churn against the BSP tiling layout. For each window count,
+// tiles that many windows, then alternately closes a random window and
+// opens a new one next to another random window. Reports how many frames
+// each operation had to reconfigure, against the window count a full
+// re-layout would touch.
+#include "tiling.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+int main(int argc, char **argv) {
+  int ops = argc > 1 ? atoi(argv[1]) : 10000;
+  const int counts[] = {10, 50, 100, 250, 500};
+
+  printf("%8s %10s %12s %12s %10s\n", "windows", "ops", "reconf/op",
+         "max/op", "us/op");
+
+  for (int count : counts) {
+    std::mt19937 rng(count);
+    BspLayout layout;
+    layout.set_area({0, 0, 3840, 2160});
+
+    std::vector<uint32_t> windows;
+    uint32_t next_id = 1;
+    for (int i = 0; i < count; i++) {
+      uint32_t near = windows.empty() ? 0 : windows.back();
+      layout.insert(next_id, near);
+      windows.push_back(next_id++);
+    }
+    layout.take_changes();
+
+    size_t total = 0;
+    size_t worst = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ops; i++) {
+      size_t pick = rng() % windows.size();
+      if (i % 2 == 0) {
+        layout.remove(windows[pick]);
+        windows[pick] = windows.back();
+        windows.pop_back();
+      } else {
+        layout.insert(next_id, windows[pick]);
+        windows.push_back(next_id++);
+      }
+      size_t changed = layout.take_changes().size();
+      total += changed;
+      if (changed > worst)
+        worst = changed;
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    double us = std::chrono::duration<double, std::micro>(elapsed).count();
+    printf("%8d %10d %12.2f %12zu %10.3f\n", count, ops,
+           static_cast<double>(total) / ops, worst, us / ops);
+  }
+  return 0;
+}
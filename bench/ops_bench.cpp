@@ -0,0 +1,182 @@
+// Runs the WM against FakeXServer and counts what the basic operations
+// cost it: managing and unmanaging windows, Alt+Tab focus cycling, moving
+// the pointer over a window, and dragging and resizing it. For each window
+// count, a fresh WM is started and every operation is followed by the
+// "sync" control command, so the X requests it caused are attributed to
+// it exactly; request, reply and error counts are the same on every run.
+// Times include the fake server and the control socket round trip.
+//
+//   ops_bench WM [OPS] [WM ARGS...]
+#include "fake_x_server.h"
+#include "wm_process.h"
+#include <X11/keysym.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const int SCREEN_WIDTH = 1920;
+const int SCREEN_HEIGHT = 1080;
+// Client windows without _NET_WM_SYNC_REQUEST are resized at most at
+// 60 Hz; resize motions are spaced out so none is coalesced by chance.
+const std::chrono::milliseconds RESIZE_SPACING(17);
+
+// Counts the requests of a run of operations and prints them as one row.
+class Measure {
+public:
+  Measure(FakeXServer &server, int windows, const char *name)
+      : server_(server), windows_(windows), name_(name),
+        start_(std::chrono::steady_clock::now()) {
+    server.reset_counts();
+  }
+
+  // Waits without counting the time.
+  void sleep(std::chrono::steady_clock::duration duration) {
+    std::this_thread::sleep_for(duration);
+    slept_ += duration;
+  }
+
+  void done(int ops) {
+    auto elapsed = std::chrono::steady_clock::now() - start_ - slept_;
+    double us = std::chrono::duration<double, std::micro>(elapsed).count();
+    const FakeXServer::Counts &c = server_.counts();
+    printf("%8d %-10s %8d %10.2f %10.2f %10.2f %10.2f %10.1f\n", windows_,
+           name_, ops, static_cast<double>(c.requests) / ops,
+           static_cast<double>(c.replies) / ops,
+           static_cast<double>(c.reply_batches) / ops,
+           static_cast<double>(c.errors) / ops, us / ops);
+  }
+
+private:
+  FakeXServer &server_;
+  int windows_;
+  const char *name_;
+  std::chrono::steady_clock::time_point start_;
+  std::chrono::steady_clock::duration slept_{};
+};
+
+xcb_window_t titlebar_of(const FakeXServer &server, xcb_window_t window) {
+  for (xcb_window_t child : server.children_of(server.parent_of(window))) {
+    if (child != window)
+      return child;
+  }
+  return XCB_NONE;
+}
+
+bool run(const std::vector<std::string> &wm_args, int count, int ops) {
+  FakeXServer server(SCREEN_WIDTH, SCREEN_HEIGHT);
+  WmProcess wm(server, wm_args);
+  if (!wm.connect()) {
+    fprintf(stderr, "%s did not start\n", wm_args[0].c_str());
+    return false;
+  }
+
+  std::vector<xcb_window_t> windows;
+  Measure manage(server, count, "manage");
+  for (int i = 0; i < count; i++) {
+    xcb_window_t window =
+        server.create_client(400, 300, "client " + std::to_string(i));
+    server.map(window);
+    windows.push_back(window);
+    if (!wm.sync())
+      return false;
+  }
+  manage.done(count);
+
+  xcb_keycode_t tab = server.keycode_of(XK_Tab);
+  xcb_keycode_t alt = server.keycode_of(XK_Alt_L);
+  Measure focus(server, count, "alt-tab");
+  server.key_press(alt, 0);
+  for (int i = 0; i < ops; i++) {
+    server.key_press(tab, XCB_MOD_MASK_1);
+    server.key_release(tab, XCB_MOD_MASK_1);
+    if (!wm.sync())
+      return false;
+  }
+  server.key_release(alt, XCB_MOD_MASK_1);
+  if (!wm.sync())
+    return false;
+  focus.done(ops);
+
+  // Drag the newest window by its titlebar, then resize it from its
+  // bottom right corner.
+  xcb_window_t frame = server.parent_of(windows.back());
+  xcb_window_t titlebar = titlebar_of(server, windows.back());
+  xcb_rectangle_t g = server.geometry(frame);
+  int x = g.x + g.width / 2;
+  int y = g.y + 15;
+
+  // Moving the pointer across the titlebar only changes the cursor once.
+  Measure hover(server, count, "hover");
+  for (int i = 0; i < ops; i++) {
+    server.motion(titlebar, x + i % 2, y);
+    if (!wm.sync())
+      return false;
+  }
+  hover.done(ops);
+
+  Measure drag(server, count, "drag");
+  server.button_press(titlebar, 1, x, y);
+  for (int i = 0; i < ops; i++) {
+    server.motion(titlebar, ++x, ++y);
+    if (!wm.sync())
+      return false;
+  }
+  server.button_release(titlebar, 1, x, y);
+  if (!wm.sync())
+    return false;
+  drag.done(ops);
+
+  g = server.geometry(frame);
+  x = g.x + g.width - 5;
+  y = g.y + g.height - 5;
+  int resize_ops = std::min(ops, 60);
+  Measure resize(server, count, "resize");
+  server.button_press(frame, 1, x, y);
+  for (int i = 0; i < resize_ops; i++) {
+    resize.sleep(RESIZE_SPACING);
+    server.motion(frame, ++x, ++y);
+    if (!wm.sync())
+      return false;
+  }
+  server.button_release(frame, 1, x, y);
+  if (!wm.sync())
+    return false;
+  resize.done(resize_ops);
+
+  Measure unmanage(server, count, "unmanage");
+  for (xcb_window_t window : windows) {
+    server.destroy(window);
+    if (!wm.sync())
+      return false;
+  }
+  unmanage.done(count);
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s WM [OPS] [WM ARGS...]\n", argv[0]);
+    return 2;
+  }
+  std::vector<std::string> wm_args = {argv[1]};
+  int ops = argc > 2 ? atoi(argv[2]) : 200;
+  for (int i = 3; i < argc; i++)
+    wm_args.push_back(argv[i]);
+  const int counts[] = {10, 100, 500};
+
+  printf("%8s %-10s %8s %10s %10s %10s %10s %10s\n", "windows", "operation",
+         "ops", "req/op", "replies/op", "batches/op", "errors/op", "us/op");
+  for (int count : counts) {
+    if (!run(wm_args, count, ops))
+      return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,70 @@
+// Cost of placing a new window with the free-space index. For each screen
+// and window count, places that many windows of random size, then times
+// find() on the up-to-date free set, and find() right after a window has
+// moved, which first releases the area the window left and occupies its
+// new one. Releasing dominates; it grows with the number of windows and
+// with how fragmented the free space around the window is.
+#include "placement.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double us_per_op(Clock::duration elapsed, int ops) {
+  return std::chrono::duration<double, std::micro>(elapsed).count() / ops;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  int ops = argc > 1 ? atoi(argv[1]) : 1000;
+  const Rect screens[] = {{0, 0, 1920, 1080}, {0, 0, 3840, 2160}};
+  const int counts[] = {10, 50, 100, 250, 500};
+
+  printf("%10s %8s %8s %12s %12s\n", "screen", "windows", "ops",
+         "fresh us/op", "moved us/op");
+
+  for (const Rect &screen : screens) {
+    for (int count : counts) {
+      std::mt19937 rng(count);
+      std::uniform_int_distribution<int> width(100, 400);
+      std::uniform_int_distribution<int> height(80, 300);
+      Placement placement;
+      placement.set_areas({screen});
+
+      std::vector<Rect> windows;
+      for (int i = 0; i < count; i++) {
+        Rect r = {0, 0, width(rng), height(rng)};
+        placement.find(r.width, r.height, 0, r.x, r.y);
+        placement.set(i, r);
+        windows.push_back(r);
+      }
+
+      // Adding windows keeps the set up to date, so these finds only scan.
+      int x, y;
+      auto start = Clock::now();
+      for (int i = 0; i < ops; i++)
+        placement.find(width(rng), height(rng), 0, x, y);
+      double fresh = us_per_op(Clock::now() - start, ops);
+
+      start = Clock::now();
+      for (int i = 0; i < ops; i++) {
+        int pick = static_cast<int>(rng() % windows.size());
+        Rect &r = windows[pick];
+        r.x += i % 2 == 0 ? 1 : -1;
+        placement.set(pick, r);
+        placement.find(width(rng), height(rng), 0, x, y);
+      }
+      double moved = us_per_op(Clock::now() - start, ops);
+
+      printf("%5dx%-4d %8d %8d %12.3f %12.3f\n", screen.width, screen.height,
+             count, ops, fresh, moved);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,388 @@
+// Replays a trace recorded with --record against a WM build running on
+// FakeXServer, and reports per event type how long the WM took to handle
+// the events and how many requests they cost it, so two builds can be
+// compared on the same workload.
+//
+// The trace is acted out rather than copied: what other applications did
+// (mapping, unmapping and destroying their windows) is done to the fake
+// server, which then sends the WM the events a server would, and input,
+// client messages, property changes and configure requests are sent as
+// recorded. Events that only followed from the WM's own requests
+// (MapNotify, Expose, FocusIn, errors, ...) are not replayed: the WM
+// under test causes its own. Windows and atoms are translated, since the
+// WM's IDs and the server's atoms differ from the recording.
+//
+// Each replayed event is followed by the "sync" control command and timed
+// up to its reply. By default events are replayed back to back;
+// --realtime keeps the recorded spacing, which matters to anything rate
+// limited (resizes) or timed (close timeouts).
+//
+// Record from the WM's start: clients it adopted at startup, and property
+// values, are not in the trace.
+//
+//   trace_replay [--realtime] TRACE WM [WM ARGS...]
+#include "event_names.h"
+#include "fake_x_server.h"
+#include "trace.h"
+#include "wm_process.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+const xcb_atom_t FIRST_DYNAMIC_ATOM = 69; // after the predefined atoms
+// For a window whose CreateNotify is not in the trace.
+const int DEFAULT_WIDTH = 640;
+const int DEFAULT_HEIGHT = 480;
+
+uint32_t get32(const uint8_t *e, size_t offset) {
+  uint32_t value;
+  memcpy(&value, e + offset, sizeof(value));
+  return value;
+}
+
+void set32(uint8_t *e, size_t offset, uint32_t value) {
+  memcpy(e + offset, &value, sizeof(value));
+}
+
+// Turns recorded events into actions on the fake server.
+class Replayer {
+public:
+  Replayer(FakeXServer &server, const TraceHeader &header)
+      : server_(server), header_(header) {
+    for (const auto &atom : header.atoms)
+      atom_names_[atom.second] = atom.first;
+  }
+
+  // Acts out event; end bounds the events after it. Returns false if it is
+  // not replayed.
+  bool replay(const TraceEvent &event, const TraceEvent *end) {
+    uint8_t e[32];
+    memcpy(e, event.data, sizeof(e));
+    bool synthetic = e[0] & 0x80;
+
+    switch (e[0] & 0x7f) {
+    case XCB_KEY_PRESS:
+    case XCB_KEY_RELEASE:
+    case XCB_BUTTON_PRESS:
+    case XCB_BUTTON_RELEASE:
+    case XCB_MOTION_NOTIFY:
+    case XCB_ENTER_NOTIFY:
+    case XCB_LEAVE_NOTIFY:
+      if (!translate(e, 8) || !translate(e, 12))
+        return false;
+      if (!translate(e, 16))
+        set32(e, 16, XCB_NONE);
+      server_.inject(e);
+      return true;
+
+    case XCB_CREATE_NOTIFY: {
+      auto *c = reinterpret_cast<xcb_create_notify_event_t *>(e);
+      if (!wm_owned(c->window)) {
+        // Applications' windows are simulated with their real size.
+        if (c->parent == header_.root && !c->override_redirect)
+          window(c->window, c->width, c->height);
+      } else if (wm_owned(c->parent)) {
+        // A titlebar; matched with the server's once its frame is known.
+        unplaced_[c->parent].push_back(c->window);
+        place_children(c->parent);
+      }
+      return false;
+    }
+
+    case XCB_REPARENT_NOTIFY:
+      learn_frame(get32(e, 12), get32(e, 8));
+      return false;
+
+    case XCB_MAP_REQUEST: {
+      if (wm_owned(get32(e, 8)))
+        return false;
+      server_.map(window(get32(e, 8), DEFAULT_WIDTH, DEFAULT_HEIGHT));
+      return true;
+    }
+
+    case XCB_UNMAP_NOTIFY: {
+      xcb_window_t recorded = get32(e, 8);
+      if (synthetic) {
+        if (!translate(e, 4) || !translate(e, 8))
+          return false;
+        server_.inject(e);
+        return true;
+      }
+      // The application withdrew its window, unless the WM unmapped it
+      // itself (and has done so again by now), or the unmap was part of a
+      // reparent or destroy, which is replayed as such.
+      xcb_window_t w = wm_owned(recorded) ? XCB_NONE : window(recorded);
+      uint8_t cause = unmap_cause(recorded, &event + 1, end);
+      if (!server_.is_mapped(w) || cause == XCB_REPARENT_NOTIFY ||
+          cause == XCB_DESTROY_NOTIFY)
+        return false;
+      server_.unmap(w);
+      return true;
+    }
+
+    case XCB_DESTROY_NOTIFY: {
+      xcb_window_t recorded = get32(e, 8);
+      xcb_window_t w = wm_owned(recorded) ? XCB_NONE : window(recorded);
+      if (!server_.exists(w))
+        return false;
+      server_.destroy(w);
+      return true;
+    }
+
+    case XCB_CONFIGURE_REQUEST:
+      if (wm_owned(get32(e, 8)))
+        return false;
+      window(get32(e, 8), DEFAULT_WIDTH, DEFAULT_HEIGHT);
+      if (!translate(e, 4) || !translate(e, 8))
+        return false;
+      if (!translate(e, 12))
+        set32(e, 12, XCB_NONE);
+      server_.inject(e);
+      return true;
+
+    case XCB_PROPERTY_NOTIFY:
+      if (!translate(e, 4))
+        return false;
+      set32(e, 8, atom(get32(e, 8)));
+      server_.inject(e);
+      return true;
+
+    case XCB_CLIENT_MESSAGE:
+      if (!translate(e, 4))
+        return false;
+      set32(e, 8, atom(get32(e, 8)));
+      // Atoms in the data (_NET_WM_STATE's properties) are recognised by
+      // value; timestamps and counts are far outside the atom range.
+      if (e[1] == 32) {
+        for (size_t offset = 12; offset < 32; offset += 4) {
+          if (atom_names_.count(get32(e, offset)))
+            set32(e, offset, atom(get32(e, offset)));
+        }
+      }
+      server_.inject(e);
+      return true;
+
+    default:
+      return false;
+    }
+  }
+
+private:
+  bool wm_owned(xcb_window_t recorded) const {
+    return recorded != XCB_NONE &&
+           (recorded & ~header_.resource_id_mask) == header_.resource_id_base;
+  }
+
+  // The server's window for a recorded one: the root, a WM window matched
+  // earlier, or an application's window, which is simulated from when it is
+  // created, given a size. XCB_NONE if there is none.
+  xcb_window_t window(xcb_window_t recorded, int width = 0, int height = 0) {
+    if (recorded == XCB_NONE)
+      return XCB_NONE;
+    if (recorded == header_.root)
+      return server_.root();
+    auto it = windows_.find(recorded);
+    if (it != windows_.end())
+      return it->second;
+    if (!width || wm_owned(recorded))
+      return XCB_NONE;
+
+    xcb_window_t w = server_.create_client(
+        width, height, "replayed " + std::to_string(recorded));
+    windows_[recorded] = w;
+    matched_.insert(w);
+    return w;
+  }
+
+  // Rewrites the window at offset. Returns false if it has no counterpart;
+  // None stays None.
+  bool translate(uint8_t *e, size_t offset) {
+    xcb_window_t recorded = get32(e, offset);
+    xcb_window_t w = window(recorded);
+    set32(e, offset, w);
+    return recorded == XCB_NONE || w != XCB_NONE;
+  }
+
+  xcb_atom_t atom(xcb_atom_t recorded) {
+    if (recorded < FIRST_DYNAMIC_ATOM)
+      return recorded;
+    auto it = atom_names_.find(recorded);
+    // Not one the WM interned, so it ignores it; any unused atom will do.
+    std::string name = it != atom_names_.end()
+                           ? it->second
+                           : "_REPLAY_" + std::to_string(recorded);
+    return server_.atom(name);
+  }
+
+  // The server reports a reparent or destroy of a mapped window as an
+  // UnmapNotify (once per selecting window) directly followed by the
+  // ReparentNotify or DestroyNotify. Returns the type of the event that
+  // follows the unmap of window just before next if it is about window,
+  // else 0.
+  static uint8_t unmap_cause(xcb_window_t window, const TraceEvent *next,
+                             const TraceEvent *end) {
+    for (; next != end; next++) {
+      uint8_t type = next->data[0] & 0x7f;
+      if (get32(next->data, 8) != window)
+        return 0;
+      if (type != XCB_UNMAP_NOTIFY)
+        return type;
+    }
+    return 0;
+  }
+
+  // The recorded WM reparented client into frame; the replayed one has
+  // done the same by now.
+  void learn_frame(xcb_window_t frame, xcb_window_t client) {
+    if (!wm_owned(frame) || wm_owned(client) || windows_.count(frame))
+      return;
+    xcb_window_t w = window(client);
+    xcb_window_t parent = server_.parent_of(w);
+    if (w == XCB_NONE || parent == server_.root() || parent == XCB_NONE)
+      return;
+    windows_[frame] = parent;
+    matched_.insert(parent);
+    place_children(frame);
+  }
+
+  // Matches the recorded WM children of frame with the server's, both in
+  // creation order.
+  void place_children(xcb_window_t frame) {
+    auto it = windows_.find(frame);
+    auto pending = unplaced_.find(frame);
+    if (it == windows_.end() || pending == unplaced_.end())
+      return;
+
+    std::vector<xcb_window_t> &recorded = pending->second;
+    for (xcb_window_t child : server_.children_of(it->second)) {
+      if (recorded.empty())
+        break;
+      if (matched_.count(child))
+        continue;
+      windows_[recorded.front()] = child;
+      matched_.insert(child);
+      recorded.erase(recorded.begin());
+    }
+    if (recorded.empty())
+      unplaced_.erase(pending);
+  }
+
+  FakeXServer &server_;
+  const TraceHeader &header_;
+  std::unordered_map<xcb_atom_t, std::string> atom_names_;
+  std::unordered_map<xcb_window_t, xcb_window_t> windows_;
+  std::unordered_set<xcb_window_t> matched_;
+  std::unordered_map<xcb_window_t, std::vector<xcb_window_t>> unplaced_;
+};
+
+struct TypeStats {
+  uint64_t count = 0;
+  uint64_t replayed = 0;
+  uint64_t requests = 0;
+  uint64_t errors = 0;
+  double total_us = 0;
+  double max_us = 0;
+};
+
+void print_row(const char *name, const TypeStats &s) {
+  double n = s.replayed ? static_cast<double>(s.replayed) : 1.0;
+  printf("%-18s %8llu %8llu %10.2f %10.2f %10.1f %10.1f\n", name,
+         static_cast<unsigned long long>(s.count),
+         static_cast<unsigned long long>(s.replayed), s.requests / n,
+         s.errors / n, s.total_us / n, s.max_us);
+}
+
+void add(TypeStats &to, const TypeStats &s) {
+  to.count += s.count;
+  to.replayed += s.replayed;
+  to.requests += s.requests;
+  to.errors += s.errors;
+  to.total_us += s.total_us;
+  to.max_us = std::max(to.max_us, s.max_us);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  bool realtime = false;
+  int arg = 1;
+  if (arg < argc && std::string(argv[arg]) == "--realtime") {
+    realtime = true;
+    arg++;
+  }
+  if (argc - arg < 2) {
+    fprintf(stderr, "usage: %s [--realtime] TRACE WM [WM ARGS...]\n",
+            argv[0]);
+    return 2;
+  }
+  const char *trace_path = argv[arg++];
+  std::vector<std::string> wm_args(argv + arg, argv + argc);
+
+  TraceHeader header;
+  std::vector<TraceEvent> events;
+  if (!trace_read(trace_path, header, events)) {
+    fprintf(stderr, "%s is not a trace\n", trace_path);
+    return 1;
+  }
+
+  FakeXServer server(header.width, header.height);
+  WmProcess wm(server, wm_args);
+  if (!wm.connect()) {
+    fprintf(stderr, "%s did not start\n", wm_args[0].c_str());
+    return 1;
+  }
+
+  Replayer replayer(server, header);
+  TypeStats stats[256];
+  auto start = std::chrono::steady_clock::now();
+  const TraceEvent *end = events.data() + events.size();
+  for (const TraceEvent &event : events) {
+    if (realtime)
+      std::this_thread::sleep_until(start +
+                                    std::chrono::microseconds(event.time_us));
+
+    TypeStats &s = stats[event.data[0] & 0x7f];
+    s.count++;
+    FakeXServer::Counts before = server.counts();
+    auto started = std::chrono::steady_clock::now();
+    if (!replayer.replay(event, end))
+      continue;
+    if (!wm.sync()) {
+      fprintf(stderr, "%s stopped responding\n", wm_args[0].c_str());
+      return 1;
+    }
+    double us = std::chrono::duration<double, std::micro>(
+                    std::chrono::steady_clock::now() - started)
+                    .count();
+    s.replayed++;
+    s.requests += server.counts().requests - before.requests;
+    s.errors += server.counts().errors - before.errors;
+    s.total_us += us;
+    s.max_us = std::max(s.max_us, us);
+  }
+
+  printf("%-18s %8s %8s %10s %10s %10s %10s\n", "event", "count",
+         "replayed", "req/event", "err/event", "mean_us", "max_us");
+  TypeStats total;
+  for (int type = 0; type < 128; type++) {
+    if (!stats[type].count)
+      continue;
+    char name[32];
+    if (const char *known = event_name(type))
+      snprintf(name, sizeof(name), "%s", known);
+    else
+      snprintf(name, sizeof(name), "extension_%d", type);
+    print_row(name, stats[type]);
+    add(total, stats[type]);
+  }
+  print_row("total", total);
+  return 0;
+}
@@ -0,0 +1,105 @@
+#include "wm_process.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+WmProcess::WmProcess(FakeXServer &server,
+                     const std::vector<std::string> &args)
+    : server_(server) {
+  snprintf(ipc_path_, sizeof(ipc_path_), "/tmp/wm-bench-%d.sock", getpid());
+
+  int x_fd = server.take_client_fd();
+  pid_ = fork();
+  if (pid_ == 0) {
+    fcntl(x_fd, F_SETFD, 0);
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+    dup2(null, STDERR_FILENO);
+
+    std::vector<std::string> argv = args;
+    argv.push_back("--x-fd");
+    argv.push_back(std::to_string(x_fd));
+    argv.push_back("--ipc");
+    argv.push_back(ipc_path_);
+    std::vector<char *> exec_argv;
+    for (std::string &arg : argv)
+      exec_argv.push_back(&arg[0]);
+    exec_argv.push_back(nullptr);
+    execv(exec_argv[0], exec_argv.data());
+    _exit(127);
+  }
+  close(x_fd);
+}
+
+WmProcess::~WmProcess() {
+  if (ipc_fd_ >= 0)
+    close(ipc_fd_);
+  if (pid_ > 0) {
+    kill(pid_, SIGTERM);
+    // The WM still has to be served until it exits.
+    for (int status; waitpid(pid_, &status, WNOHANG) == 0;)
+      serve(10);
+  }
+  unlink(ipc_path_);
+}
+
+bool WmProcess::connect() {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (std::chrono::steady_clock::now() < deadline) {
+    if (!serve(10))
+      return false;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, ipc_path_, sizeof(addr.sun_path) - 1);
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) ==
+        0) {
+      ipc_fd_ = fd;
+      return sync();
+    }
+    close(fd);
+  }
+  return false;
+}
+
+bool WmProcess::sync() {
+  const char command[] = "sync\n";
+  if (send(ipc_fd_, command, sizeof(command) - 1, MSG_NOSIGNAL) < 0)
+    return false;
+
+  std::string reply;
+  while (reply.find('\n') == std::string::npos) {
+    pollfd fds[] = {{server_.fd(), POLLIN, 0}, {ipc_fd_, POLLIN, 0}};
+    if (server_.wants_write())
+      fds[0].events |= POLLOUT;
+    if (poll(fds, 2, 5000) <= 0)
+      return false;
+    if (fds[0].revents && !server_.serve())
+      return false;
+    if (fds[1].revents) {
+      char buf[256];
+      ssize_t n = read(ipc_fd_, buf, sizeof(buf));
+      if (n <= 0)
+        return false;
+      reply.append(buf, n);
+    }
+  }
+  // The WM flushed X before answering.
+  server_.serve();
+  return reply == "ok\n";
+}
+
+bool WmProcess::serve(int timeout_ms) {
+  pollfd fd = {server_.fd(), POLLIN, 0};
+  if (server_.wants_write())
+    fd.events |= POLLOUT;
+  poll(&fd, 1, timeout_ms);
+  return server_.serve();
+}
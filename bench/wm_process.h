@@ -0,0 +1,33 @@
+#pragma once
+
+#include "fake_x_server.h"
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+// The WM as a child process of a benchmark, with X going through a
+// FakeXServer and commands through its control socket. args[0] is the WM
+// binary; --x-fd and --ipc are added.
+class WmProcess {
+public:
+  WmProcess(FakeXServer &server, const std::vector<std::string> &args);
+  ~WmProcess();
+
+  WmProcess(const WmProcess &) = delete;
+  WmProcess &operator=(const WmProcess &) = delete;
+
+  // Serves X until the control socket accepts a connection.
+  bool connect();
+
+  // Returns once the WM has handled everything the server has sent it,
+  // serving its requests meanwhile.
+  bool sync();
+
+private:
+  bool serve(int timeout_ms);
+
+  FakeXServer &server_;
+  pid_t pid_ = -1;
+  int ipc_fd_ = -1;
+  char ipc_path_[64];
+};
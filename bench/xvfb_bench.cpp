@@ -0,0 +1,598 @@
+// Runs the WM under a private Xvfb and measures it from the outside, as a
+// user would see it. For each client count, a fresh server and WM are
+// started, and that many synthetic clients (windows of this process's
+// connection) go through:
+//
+//   manage    map a window, until it is reparented and mapped
+//   retitle   change WM_NAME (load only: nothing observable follows)
+//   resize    ConfigureWindow on the client, until its ConfigureNotify
+//   drag      XTEST pointer motion over a held titlebar, until the frame's
+//             ConfigureNotify
+//   alt-tab   XTEST Alt+Tab, until a client gets FocusIn
+//   close     _NET_CLOSE_WINDOW, until the WM_DELETE_WINDOW message
+//   unmanage  destroying the window, until its frame is destroyed
+//
+// Each operation is waited for before the next, so latencies are not
+// hidden by pipelining. Every row also has the WM's CPU time over the
+// phase and its RSS at the end of it, from /proc. Exits non-zero if the
+// WM misses an operation, so a release check can run it as is.
+//
+//   xvfb_bench [--xvfb PATH] [--clients N,...] [--ops N] WM [WM ARGS...]
+#include <X11/keysym.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+#include <xcb/xcb.h>
+#include <xcb/xtest.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const int SCREEN_WIDTH = 1920;
+const int SCREEN_HEIGHT = 1080;
+const int CLIENT_WIDTH = 400;
+const int CLIENT_HEIGHT = 300;
+const int TIMEOUT_MS = 5000;
+
+pid_t spawn(const std::vector<std::string> &args, const char *display,
+            int keep_fd = -1) {
+  pid_t pid = fork();
+  if (pid != 0)
+    return pid;
+
+  if (keep_fd >= 0)
+    fcntl(keep_fd, F_SETFD, 0);
+  int null = open("/dev/null", O_WRONLY);
+  dup2(null, STDOUT_FILENO);
+  dup2(null, STDERR_FILENO);
+  if (display)
+    setenv("DISPLAY", display, 1);
+
+  std::vector<std::string> argv = args;
+  std::vector<char *> exec_argv;
+  for (std::string &arg : argv)
+    exec_argv.push_back(&arg[0]);
+  exec_argv.push_back(nullptr);
+  execvp(exec_argv[0], exec_argv.data());
+  _exit(127);
+}
+
+void stop(pid_t pid) {
+  if (pid <= 0)
+    return;
+  kill(pid, SIGTERM);
+  int status;
+  waitpid(pid, &status, 0);
+}
+
+// Xvfb on the first free display, which it reports through -displayfd.
+pid_t start_xvfb(const std::string &path, std::string &display) {
+  int fds[2];
+  if (pipe2(fds, O_CLOEXEC) < 0)
+    return -1;
+  std::string screen = std::to_string(SCREEN_WIDTH) + "x" +
+                       std::to_string(SCREEN_HEIGHT) + "x24";
+  pid_t pid = spawn({path, "-displayfd", std::to_string(fds[1]), "-screen",
+                     "0", screen, "-nolisten", "tcp", "-noreset"},
+                    nullptr, fds[1]);
+  close(fds[1]);
+
+  std::string number;
+  char c;
+  pollfd fd = {fds[0], POLLIN, 0};
+  while (poll(&fd, 1, TIMEOUT_MS) > 0 && read(fds[0], &c, 1) == 1 &&
+         c != '\n')
+    number += c;
+  close(fds[0]);
+  if (number.empty()) {
+    stop(pid);
+    return -1;
+  }
+  display = ":" + number;
+  return pid;
+}
+
+// CPU time and resident set of a process, from /proc.
+struct Usage {
+  double cpu_ms = 0;
+  long rss_kb = 0;
+};
+
+Usage usage_of(pid_t pid) {
+  Usage u;
+  std::string path = "/proc/" + std::to_string(pid);
+  if (FILE *f = fopen((path + "/stat").c_str(), "r")) {
+    char buf[1024];
+    size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+    buf[n] = '\0';
+    fclose(f);
+    // utime and stime are fields 14 and 15; the command name before them
+    // may contain spaces, so count from its closing parenthesis.
+    if (const char *p = strrchr(buf, ')')) {
+      unsigned long utime = 0, stime = 0;
+      if (sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+                 &utime, &stime) == 2)
+        u.cpu_ms = (utime + stime) * 1000.0 / sysconf(_SC_CLK_TCK);
+    }
+  }
+  if (FILE *f = fopen((path + "/status").c_str(), "r")) {
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+      if (sscanf(line, "VmRSS: %ld", &u.rss_kb) == 1)
+        break;
+    }
+    fclose(f);
+  }
+  return u;
+}
+
+// Latencies of one phase, printed as one row.
+class Phase {
+public:
+  Phase(pid_t wm, int clients, const char *name)
+      : wm_(wm), clients_(clients), name_(name), start_(usage_of(wm)) {}
+
+  void add(Clock::duration latency) {
+    samples_.push_back(std::chrono::duration<double, std::micro>(latency)
+                           .count());
+  }
+
+  void done(int ops) {
+    Usage end = usage_of(wm_);
+    printf("%8d %-10s %6d", clients_, name_, ops);
+    if (samples_.empty()) {
+      printf(" %9s %9s %9s %9s", "-", "-", "-", "-");
+    } else {
+      std::sort(samples_.begin(), samples_.end());
+      double total = 0;
+      for (double us : samples_)
+        total += us;
+      printf(" %9.1f %9.1f %9.1f %9.1f", total / samples_.size(),
+             quantile(0.5), quantile(0.99), samples_.back());
+    }
+    printf(" %10.1f %9ld\n", end.cpu_ms - start_.cpu_ms, end.rss_kb);
+    fflush(stdout);
+  }
+
+private:
+  double quantile(double q) const {
+    size_t index = static_cast<size_t>(q * (samples_.size() - 1));
+    return samples_[index];
+  }
+
+  pid_t wm_;
+  int clients_;
+  const char *name_;
+  Usage start_;
+  std::vector<double> samples_;
+};
+
+// The synthetic clients and the XTEST input, on one connection.
+class Driver {
+public:
+  explicit Driver(const std::string &display) {
+    conn_ = xcb_connect(display.c_str(), nullptr);
+    if (xcb_connection_has_error(conn_))
+      return;
+    screen_ = xcb_setup_roots_iterator(xcb_get_setup(conn_)).data;
+    const xcb_query_extension_reply_t *xtest =
+        xcb_get_extension_data(conn_, &xcb_test_id);
+    if (!xtest || !xtest->present) {
+      fprintf(stderr, "the X server has no XTEST\n");
+      return;
+    }
+    net_supporting_wm_check_ = intern("_NET_SUPPORTING_WM_CHECK");
+    net_close_window_ = intern("_NET_CLOSE_WINDOW");
+    wm_protocols_ = intern("WM_PROTOCOLS");
+    wm_delete_window_ = intern("WM_DELETE_WINDOW");
+    tab_ = keycode_of(XK_Tab);
+    alt_ = keycode_of(XK_Alt_L);
+    valid_ = tab_ && alt_;
+  }
+
+  ~Driver() { xcb_disconnect(conn_); }
+
+  bool is_valid() const { return valid_; }
+  xcb_window_t root() const { return screen_->root; }
+
+  // Waits for the WM to advertise itself on the root.
+  bool wait_for_wm() {
+    auto deadline = Clock::now() + std::chrono::milliseconds(TIMEOUT_MS);
+    while (Clock::now() < deadline) {
+      xcb_get_property_reply_t *reply = xcb_get_property_reply(
+          conn_,
+          xcb_get_property(conn_, 0, root(), net_supporting_wm_check_,
+                           XCB_ATOM_WINDOW, 0, 1),
+          nullptr);
+      bool found = reply && xcb_get_property_value_length(reply) == 4;
+      free(reply);
+      if (found)
+        return true;
+      usleep(10000);
+    }
+    return false;
+  }
+
+  xcb_window_t create_client(int index) {
+    xcb_window_t window = xcb_generate_id(conn_);
+    uint32_t events =
+        XCB_EVENT_MASK_STRUCTURE_NOTIFY | XCB_EVENT_MASK_FOCUS_CHANGE;
+    xcb_create_window(conn_, XCB_COPY_FROM_PARENT, window, root(), 0, 0,
+                      CLIENT_WIDTH, CLIENT_HEIGHT, 0,
+                      XCB_WINDOW_CLASS_INPUT_OUTPUT, screen_->root_visual,
+                      XCB_CW_EVENT_MASK, &events);
+    xcb_change_property(conn_, XCB_PROP_MODE_REPLACE, window, wm_protocols_,
+                        XCB_ATOM_ATOM, 32, 1, &wm_delete_window_);
+    set_title(window, "client " + std::to_string(index));
+    return window;
+  }
+
+  void set_title(xcb_window_t window, const std::string &title) {
+    xcb_change_property(conn_, XCB_PROP_MODE_REPLACE, window,
+                        XCB_ATOM_WM_NAME, XCB_ATOM_STRING, 8, title.size(),
+                        title.data());
+  }
+
+  // The frame the WM put window in; its structure events are selected.
+  xcb_window_t frame_of(xcb_window_t window) {
+    xcb_query_tree_reply_t *tree = xcb_query_tree_reply(
+        conn_, xcb_query_tree(conn_, window), nullptr);
+    if (!tree)
+      return XCB_NONE;
+    xcb_window_t frame = tree->parent;
+    free(tree);
+    uint32_t events = XCB_EVENT_MASK_STRUCTURE_NOTIFY;
+    xcb_change_window_attributes(conn_, frame, XCB_CW_EVENT_MASK, &events);
+    return frame;
+  }
+
+  // Outer geometry of a top-level window.
+  xcb_get_geometry_reply_t geometry(xcb_window_t window) {
+    xcb_get_geometry_reply_t g = {};
+    if (xcb_get_geometry_reply_t *reply = xcb_get_geometry_reply(
+            conn_, xcb_get_geometry(conn_, window), nullptr)) {
+      g = *reply;
+      free(reply);
+    }
+    return g;
+  }
+
+  void close_request(xcb_window_t window) {
+    xcb_client_message_event_t e = {};
+    e.response_type = XCB_CLIENT_MESSAGE;
+    e.format = 32;
+    e.window = window;
+    e.type = net_close_window_;
+    e.data.data32[0] = XCB_CURRENT_TIME;
+    e.data.data32[1] = 2; // from a pager
+    xcb_send_event(conn_, 0, root(),
+                   XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT |
+                       XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY,
+                   reinterpret_cast<const char *>(&e));
+  }
+
+  bool is_delete_request(const xcb_generic_event_t *event,
+                         xcb_window_t window) const {
+    if ((event->response_type & 0x7f) != XCB_CLIENT_MESSAGE)
+      return false;
+    auto *e = reinterpret_cast<const xcb_client_message_event_t *>(event);
+    return e->window == window && e->type == wm_protocols_ &&
+           e->data.data32[0] == wm_delete_window_;
+  }
+
+  void fake(uint8_t type, uint8_t detail, int x = 0, int y = 0) {
+    xcb_test_fake_input(conn_, type, detail, XCB_CURRENT_TIME, root(), x, y,
+                        0);
+  }
+  xcb_keycode_t tab() const { return tab_; }
+  xcb_keycode_t alt() const { return alt_; }
+
+  xcb_connection_t *get() const { return conn_; }
+
+  // Makes a round trip, then drops every event received.
+  void drain() {
+    free(xcb_get_input_focus_reply(conn_, xcb_get_input_focus(conn_),
+                                   nullptr));
+    while (xcb_generic_event_t *event = xcb_poll_for_event(conn_))
+      free(event);
+  }
+
+  // Flushes, then returns the first event match accepts, dropping the
+  // others, or nullptr after TIMEOUT_MS. The caller frees it.
+  template <typename Match> xcb_generic_event_t *wait(Match match) {
+    xcb_flush(conn_);
+    auto deadline = Clock::now() + std::chrono::milliseconds(TIMEOUT_MS);
+    while (true) {
+      while (xcb_generic_event_t *event = xcb_poll_for_event(conn_)) {
+        if (match(event))
+          return event;
+        free(event);
+      }
+      auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+          deadline - Clock::now());
+      if (left.count() <= 0 || xcb_connection_has_error(conn_))
+        return nullptr;
+      pollfd fd = {xcb_get_file_descriptor(conn_), POLLIN, 0};
+      poll(&fd, 1, left.count());
+    }
+  }
+
+private:
+  xcb_atom_t intern(const char *name) {
+    xcb_intern_atom_reply_t *reply = xcb_intern_atom_reply(
+        conn_, xcb_intern_atom(conn_, 0, strlen(name), name), nullptr);
+    if (!reply)
+      return XCB_ATOM_NONE;
+    xcb_atom_t atom = reply->atom;
+    free(reply);
+    return atom;
+  }
+
+  xcb_keycode_t keycode_of(xcb_keysym_t keysym) {
+    const xcb_setup_t *setup = xcb_get_setup(conn_);
+    xcb_get_keyboard_mapping_reply_t *map = xcb_get_keyboard_mapping_reply(
+        conn_,
+        xcb_get_keyboard_mapping(conn_, setup->min_keycode,
+                                 setup->max_keycode - setup->min_keycode + 1),
+        nullptr);
+    if (!map)
+      return 0;
+    xcb_keycode_t keycode = 0;
+    const xcb_keysym_t *syms = xcb_get_keyboard_mapping_keysyms(map);
+    int count = xcb_get_keyboard_mapping_keysyms_length(map);
+    for (int i = 0; i < count && !keycode; i++) {
+      if (syms[i] == keysym)
+        keycode = setup->min_keycode + i / map->keysyms_per_keycode;
+    }
+    free(map);
+    return keycode;
+  }
+
+  xcb_connection_t *conn_ = nullptr;
+  xcb_screen_t *screen_ = nullptr;
+  bool valid_ = false;
+  xcb_atom_t net_supporting_wm_check_ = XCB_ATOM_NONE;
+  xcb_atom_t net_close_window_ = XCB_ATOM_NONE;
+  xcb_atom_t wm_protocols_ = XCB_ATOM_NONE;
+  xcb_atom_t wm_delete_window_ = XCB_ATOM_NONE;
+  xcb_keycode_t tab_ = 0;
+  xcb_keycode_t alt_ = 0;
+};
+
+// Structure events name the window they are about at offset 8.
+bool is_notify(const xcb_generic_event_t *event, uint8_t type,
+               xcb_window_t window) {
+  xcb_window_t w;
+  memcpy(&w, reinterpret_cast<const uint8_t *>(event) + 8, sizeof(w));
+  return (event->response_type & 0x7f) == type && w == window;
+}
+
+// Does action and records how long until an event match accepts arrives.
+// Events still queued from earlier are dropped first, so they cannot be
+// taken for the answer. False on timeout.
+template <typename Action, typename Match>
+bool measure(Driver &x, Phase &phase, Action action, Match match) {
+  x.drain();
+  auto start = Clock::now();
+  action();
+  xcb_generic_event_t *event = x.wait(match);
+  if (!event)
+    return false;
+  phase.add(Clock::now() - start);
+  free(event);
+  return true;
+}
+
+bool run(const std::string &xvfb, const std::vector<std::string> &wm_args,
+         int count, int ops) {
+  std::string display;
+  pid_t server = start_xvfb(xvfb, display);
+  if (server < 0) {
+    fprintf(stderr, "%s did not start\n", xvfb.c_str());
+    return false;
+  }
+
+  bool ok = false;
+  pid_t wm = -1;
+  {
+    Driver x(display);
+    if (x.is_valid()) {
+      wm = spawn(wm_args, display.c_str());
+      if (x.wait_for_wm())
+        ok = true;
+      else
+        fprintf(stderr, "%s did not start\n", wm_args[0].c_str());
+    }
+
+    std::vector<xcb_window_t> windows;
+    std::vector<xcb_window_t> frames;
+    auto fail = [&](const char *what) {
+      fprintf(stderr, "%d clients: the WM missed a %s\n", count, what);
+      ok = false;
+    };
+
+    if (ok) {
+      Phase manage(wm, count, "manage");
+      for (int i = 0; i < count && ok; i++) {
+        xcb_window_t window = x.create_client(i);
+        if (!measure(
+                x, manage, [&]() { xcb_map_window(x.get(), window); },
+                [&](xcb_generic_event_t *e) {
+                  return is_notify(e, XCB_MAP_NOTIFY, window);
+                }))
+          fail("map");
+        windows.push_back(window);
+        frames.push_back(x.frame_of(window));
+      }
+      if (ok)
+        manage.done(count);
+    }
+
+    if (ok) {
+      Phase retitle(wm, count, "retitle");
+      for (int i = 0; i < ops; i++)
+        x.set_title(windows[i % count], "retitled " + std::to_string(i));
+      x.drain();
+      retitle.done(ops);
+    }
+
+    if (ok) {
+      Phase resize(wm, count, "resize");
+      for (int i = 0; i < ops && ok; i++) {
+        xcb_window_t window = windows[i % count];
+        uint32_t size[] = {
+            static_cast<uint32_t>(CLIENT_WIDTH + (i % 2 ? 0 : 40)),
+            static_cast<uint32_t>(CLIENT_HEIGHT + (i % 2 ? 0 : 30))};
+        auto request = [&]() {
+          xcb_configure_window(
+              x.get(), window,
+              XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT, size);
+        };
+        if (!measure(x, resize, request, [&](xcb_generic_event_t *e) {
+              return is_notify(e, XCB_CONFIGURE_NOTIFY, window);
+            }))
+          fail("ConfigureRequest");
+      }
+      if (ok)
+        resize.done(ops);
+    }
+
+    if (ok) {
+      // Hold the newest window's titlebar and move it diagonally.
+      xcb_window_t frame = frames.back();
+      xcb_get_geometry_reply_t g = x.geometry(frame);
+      int px = g.x + g.border_width + g.width / 2;
+      int py = g.y + g.border_width + 12;
+      x.fake(XCB_MOTION_NOTIFY, 0, px, py);
+      x.fake(XCB_BUTTON_PRESS, 1);
+
+      Phase drag(wm, count, "drag");
+      for (int i = 0; i < ops && ok; i++) {
+        int step = i % 200 < 100 ? 1 : -1;
+        px += step;
+        py += step;
+        auto move = [&]() { x.fake(XCB_MOTION_NOTIFY, 0, px, py); };
+        if (!measure(x, drag, move, [&](xcb_generic_event_t *e) {
+              return is_notify(e, XCB_CONFIGURE_NOTIFY, frame);
+            }))
+          fail("drag motion");
+      }
+      x.fake(XCB_BUTTON_RELEASE, 1);
+      if (ok)
+        drag.done(ops);
+    }
+
+    if (ok) {
+      Phase alt_tab(wm, count, "alt-tab");
+      x.fake(XCB_KEY_PRESS, x.alt());
+      for (int i = 0; i < ops && ok; i++) {
+        auto tab = [&]() {
+          x.fake(XCB_KEY_PRESS, x.tab());
+          x.fake(XCB_KEY_RELEASE, x.tab());
+        };
+        if (!measure(x, alt_tab, tab, [&](xcb_generic_event_t *e) {
+              auto *f = reinterpret_cast<xcb_focus_in_event_t *>(e);
+              return (e->response_type & 0x7f) == XCB_FOCUS_IN &&
+                     f->detail != XCB_NOTIFY_DETAIL_POINTER;
+            }))
+          fail("Alt+Tab");
+      }
+      x.fake(XCB_KEY_RELEASE, x.alt());
+      if (ok)
+        alt_tab.done(ops);
+    }
+
+    if (ok) {
+      // Close and destroy the windows in turn: the WM's part of a close
+      // is asking, its part of a destroy is cleaning up.
+      Phase close(wm, count, "close");
+      Phase unmanage(wm, count, "unmanage");
+      for (int i = 0; i < count && ok; i++) {
+        xcb_window_t window = windows[i];
+        if (!measure(
+                x, close, [&]() { x.close_request(window); },
+                [&](xcb_generic_event_t *e) {
+                  return x.is_delete_request(e, window);
+                })) {
+          fail("_NET_CLOSE_WINDOW");
+          break;
+        }
+        if (!measure(
+                x, unmanage, [&]() { xcb_destroy_window(x.get(), window); },
+                [&](xcb_generic_event_t *e) {
+                  return is_notify(e, XCB_DESTROY_NOTIFY, frames[i]);
+                }))
+          fail("DestroyNotify");
+      }
+      if (ok) {
+        close.done(count);
+        unmanage.done(count);
+      }
+    }
+  }
+
+  stop(wm);
+  stop(server);
+  return ok;
+}
+
+std::vector<int> parse_counts(const char *list) {
+  std::vector<int> counts;
+  for (const char *p = list; *p;) {
+    char *end;
+    long n = strtol(p, &end, 10);
+    if (end == p || n <= 0)
+      return {};
+    counts.push_back(static_cast<int>(n));
+    p = *end == ',' ? end + 1 : end;
+  }
+  return counts;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::string xvfb = "Xvfb";
+  std::vector<int> counts = {10, 100, 1000};
+  int ops = 200;
+  int arg = 1;
+  for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2) {
+    std::string option = argv[arg];
+    if (option == "--xvfb")
+      xvfb = argv[arg + 1];
+    else if (option == "--clients")
+      counts = parse_counts(argv[arg + 1]);
+    else if (option == "--ops")
+      ops = atoi(argv[arg + 1]);
+    else
+      break;
+  }
+  if (arg >= argc || counts.empty() || ops <= 0) {
+    fprintf(stderr,
+            "usage: %s [--xvfb PATH] [--clients N,...] [--ops N] WM "
+            "[WM ARGS...]\n",
+            argv[0]);
+    return 2;
+  }
+  std::vector<std::string> wm_args(argv + arg, argv + argc);
+  signal(SIGPIPE, SIG_IGN);
+
+  printf("%8s %-10s %6s %9s %9s %9s %9s %10s %9s\n", "clients", "operation",
+         "ops", "mean_us", "p50_us", "p99_us", "max_us", "wm_cpu_ms",
+         "rss_kb");
+  for (int count : counts) {
+    if (!run(xvfb, wm_args, count, ops))
+      return 1;
+  }
+  return 0;
+}
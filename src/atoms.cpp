@@ -0,0 +1,65 @@
+#include "atoms.h"
+#include "stats.h"
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+struct AtomName {
+  const char *name;
+  xcb_atom_t Atoms::*member;
+};
+
+const AtomName atom_names[] = {
+    {"_NET_WM_NAME", &Atoms::net_wm_name},
+    {"WM_PROTOCOLS", &Atoms::wm_protocols},
+    {"WM_DELETE_WINDOW", &Atoms::wm_delete_window},
+    {"_NET_WM_SYNC_REQUEST", &Atoms::net_wm_sync_request},
+    {"_NET_WM_SYNC_REQUEST_COUNTER", &Atoms::net_wm_sync_request_counter},
+    {"UTF8_STRING", &Atoms::utf8_string},
+    {"_NET_SUPPORTED", &Atoms::net_supported},
+    {"_NET_SUPPORTING_WM_CHECK", &Atoms::net_supporting_wm_check},
+    {"_NET_CLIENT_LIST", &Atoms::net_client_list},
+    {"_NET_CLIENT_LIST_STACKING", &Atoms::net_client_list_stacking},
+    {"_NET_ACTIVE_WINDOW", &Atoms::net_active_window},
+    {"_NET_CLOSE_WINDOW", &Atoms::net_close_window},
+    {"_NET_WM_STATE", &Atoms::net_wm_state},
+    {"_NET_WM_STATE_FULLSCREEN", &Atoms::net_wm_state_fullscreen},
+    {"_NET_NUMBER_OF_DESKTOPS", &Atoms::net_number_of_desktops},
+    {"_NET_CURRENT_DESKTOP", &Atoms::net_current_desktop},
+    {"_NET_WM_DESKTOP", &Atoms::net_wm_desktop},
+};
+
+const size_t atom_count = sizeof(atom_names) / sizeof(atom_names[0]);
+
+} // namespace
+
+bool Atoms::intern(xcb_connection_t *conn) {
+  xcb_intern_atom_cookie_t cookies[atom_count];
+
+  for (size_t i = 0; i < atom_count; i++) {
+    cookies[i] = xcb_intern_atom(conn, 0, strlen(atom_names[i].name),
+                                 atom_names[i].name);
+  }
+
+  bool ok = true;
+  for (size_t i = 0; i < atom_count; i++) {
+    stats_round_trip();
+    xcb_intern_atom_reply_t *reply =
+        xcb_intern_atom_reply(conn, cookies[i], nullptr);
+    if (!reply) {
+      ok = false;
+      continue;
+    }
+    this->*atom_names[i].member = reply->atom;
+    free(reply);
+  }
+  return ok;
+}
+
+std::vector<std::pair<std::string, xcb_atom_t>> Atoms::list() const {
+  std::vector<std::pair<std::string, xcb_atom_t>> atoms;
+  for (const AtomName &atom : atom_names)
+    atoms.emplace_back(atom.name, this->*atom.member);
+  return atoms;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+#include <xcb/xcb.h>
+
+// Atoms the WM compares against or sets, interned once at startup. Atoms
+// predefined by the core protocol (WM_NAME, ...) use the XCB_ATOM_*
+// constants directly.
+struct Atoms {
+  xcb_atom_t net_wm_name = XCB_ATOM_NONE;
+  xcb_atom_t wm_protocols = XCB_ATOM_NONE;
+  xcb_atom_t wm_delete_window = XCB_ATOM_NONE;
+  xcb_atom_t net_wm_sync_request = XCB_ATOM_NONE;
+  xcb_atom_t net_wm_sync_request_counter = XCB_ATOM_NONE;
+  xcb_atom_t utf8_string = XCB_ATOM_NONE;
+  xcb_atom_t net_supported = XCB_ATOM_NONE;
+  xcb_atom_t net_supporting_wm_check = XCB_ATOM_NONE;
+  xcb_atom_t net_client_list = XCB_ATOM_NONE;
+  xcb_atom_t net_client_list_stacking = XCB_ATOM_NONE;
+  xcb_atom_t net_active_window = XCB_ATOM_NONE;
+  xcb_atom_t net_close_window = XCB_ATOM_NONE;
+  xcb_atom_t net_wm_state = XCB_ATOM_NONE;
+  xcb_atom_t net_wm_state_fullscreen = XCB_ATOM_NONE;
+  xcb_atom_t net_number_of_desktops = XCB_ATOM_NONE;
+  xcb_atom_t net_current_desktop = XCB_ATOM_NONE;
+  xcb_atom_t net_wm_desktop = XCB_ATOM_NONE;
+
+  // Sends all intern requests in one batch, then collects the replies.
+  // Returns false if any atom could not be resolved.
+  bool intern(xcb_connection_t *conn);
+
+  // Every interned atom with its name, for traces.
+  std::vector<std::pair<std::string, xcb_atom_t>> list() const;
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <xcb/xcb.h>
+
+// Reasons a client's titlebar needs repainting.
+enum : uint8_t {
+  DIRTY_FOCUS = 1 << 0,
+  DIRTY_TITLE = 1 << 1,
+  DIRTY_SIZE = 1 << 2,
+  DIRTY_EXPOSED = 1 << 3,
+};
+
+// Stable reference to a client. A handle outlives the client it names and
+// simply stops resolving once that client is erased.
+struct ClientHandle {
+  uint32_t slot = UINT32_MAX;
+  uint32_t generation = 0;
+
+  bool operator==(const ClientHandle &o) const {
+    return slot == o.slot && generation == o.generation;
+  }
+  bool operator!=(const ClientHandle &o) const { return !(*this == o); }
+};
+
+// A client's neighbours in one kind of ClientList.
+struct ClientLink {
+  ClientHandle prev, next;
+};
+
+// Geometry is the WM's authoritative copy: x/y is the frame origin on the
+// root, width/height is the client area below the titlebar.
+struct Client {
+  xcb_window_t frame;
+  xcb_window_t titlebar;
+  xcb_window_t window;
+  xcb_gcontext_t titlebar_gc;
+  int x, y;
+  int width, height;
+  std::string title;
+  uint8_t dirty = 0;
+  uint8_t workspace = 0;
+  uint8_t monitor = 0; // tiling tree the client is in
+  // UnmapNotify events caused by the WM itself, still to arrive.
+  uint8_t ignore_unmaps = 0;
+  // The cursor last set on the frame, so hovering only sends changes.
+  xcb_cursor_t cursor = XCB_NONE;
+
+  // _NET_WM_STATE_FULLSCREEN: the frame is pushed out so the client covers
+  // its monitor. saved_* is the geometry to go back to.
+  bool fullscreen = false;
+  int saved_x = 0, saved_y = 0;
+  int saved_width = 0, saved_height = 0;
+
+  // Pre-rendered titlebars, [0] inactive and [1] active, pixmap_width wide
+  // and showing pixmap_title.
+  xcb_pixmap_t titlebar_pixmaps[2] = {XCB_NONE, XCB_NONE};
+  int pixmap_width = 0;
+  std::string pixmap_title = "";
+
+  // WM_DELETE_WINDOW support, and the timer that kills the client if it
+  // has not exited after being asked to (0 when no close is pending).
+  bool supports_delete = false;
+  uint64_t close_timer = 0;
+
+  // _NET_WM_SYNC_REQUEST support; sync_counter is XCB_NONE when the client
+  // does not take part in the protocol.
+  uint32_t sync_counter = XCB_NONE;
+  uint32_t sync_alarm = XCB_NONE;
+  uint64_t sync_value = 0;
+
+  // Neighbours in the focus history of the client's workspace, the
+  // stacking order and the _NET_CLIENT_LIST order (see ClientList).
+  ClientLink focus_link = {}, stack_link = {}, order_link = {};
+};
@@ -0,0 +1,86 @@
+#include "client_list.h"
+
+void ClientList::push_front(ClientTable &clients, ClientHandle handle) {
+  Client *c = clients.get(handle);
+  if (!c)
+    return;
+  link(*c) = {ClientHandle(), head_};
+  if (Client *head = clients.get(head_))
+    link(*head).prev = handle;
+  else
+    tail_ = handle;
+  head_ = handle;
+  size_++;
+}
+
+void ClientList::push_back(ClientTable &clients, ClientHandle handle) {
+  Client *c = clients.get(handle);
+  if (!c)
+    return;
+  link(*c) = {tail_, ClientHandle()};
+  if (Client *tail = clients.get(tail_))
+    link(*tail).next = handle;
+  else
+    head_ = handle;
+  tail_ = handle;
+  size_++;
+}
+
+void ClientList::insert_after(ClientTable &clients, ClientHandle handle,
+                              ClientHandle after) {
+  Client *c = clients.get(handle);
+  Client *prev = clients.get(after);
+  if (!c || !prev)
+    return;
+  ClientHandle next = link(*prev).next;
+  link(*c) = {after, next};
+  link(*prev).next = handle;
+  if (Client *n = clients.get(next))
+    link(*n).prev = handle;
+  else
+    tail_ = handle;
+  size_++;
+}
+
+void ClientList::remove(ClientTable &clients, ClientHandle handle) {
+  if (!contains(clients, handle))
+    return;
+  ClientLink &l = link(*clients.get(handle));
+  if (Client *prev = clients.get(l.prev))
+    link(*prev).next = l.next;
+  else
+    head_ = l.next;
+  if (Client *next = clients.get(l.next))
+    link(*next).prev = l.prev;
+  else
+    tail_ = l.prev;
+  l = ClientLink();
+  size_--;
+}
+
+void ClientList::move_to_front(ClientTable &clients, ClientHandle handle) {
+  if (handle == head_ || !contains(clients, handle))
+    return;
+  remove(clients, handle);
+  push_front(clients, handle);
+}
+
+void ClientList::move_to_back(ClientTable &clients, ClientHandle handle) {
+  if (handle == tail_ || !contains(clients, handle))
+    return;
+  remove(clients, handle);
+  push_back(clients, handle);
+}
+
+bool ClientList::contains(ClientTable &clients, ClientHandle handle) {
+  // Only the head has no predecessor.
+  Client *c = clients.get(handle);
+  return c && (handle == head_ || clients.get(link(*c).prev));
+}
+
+ClientHandle ClientList::next(ClientTable &clients, ClientHandle handle) {
+  Client *c = clients.get(handle);
+  if (!c || !clients.get(link(*c).next))
+    return head_;
+  return link(*c).next;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "client_table.h"
+#include <cstddef>
+
+// A doubly linked list of clients, threaded through the clients themselves
+// by handle (one ClientLink member per kind of list), so inserting,
+// removing and moving a client are O(1). Handles stay valid while
+// ClientTable moves clients around. A client is in at most one list of
+// each kind.
+class ClientList {
+public:
+  explicit ClientList(ClientLink Client::*link) : link_(link) {}
+
+  void push_front(ClientTable &clients, ClientHandle handle);
+  void push_back(ClientTable &clients, ClientHandle handle);
+  // Inserts handle right after after, which must be in the list.
+  void insert_after(ClientTable &clients, ClientHandle handle,
+                    ClientHandle after);
+  // Does nothing if handle is in no list of this kind.
+  void remove(ClientTable &clients, ClientHandle handle);
+  void move_to_front(ClientTable &clients, ClientHandle handle);
+  void move_to_back(ClientTable &clients, ClientHandle handle);
+
+  bool contains(ClientTable &clients, ClientHandle handle);
+  ClientHandle front() const { return head_; }
+  ClientHandle back() const { return tail_; }
+  // The client after handle, wrapping around to the front.
+  ClientHandle next(ClientTable &clients, ClientHandle handle);
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  // Calls f with each client, front to back. f must not change the list.
+  template <typename F> void for_each(ClientTable &clients, F f) const {
+    for (Client *c = clients.get(head_); c; c = clients.get((c->*link_).next))
+      f(*c);
+  }
+
+private:
+  ClientLink &link(Client &c) const { return c.*link_; }
+
+  ClientLink Client::*link_;
+  ClientHandle head_, tail_;
+  size_t size_ = 0;
+};
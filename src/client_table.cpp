@@ -0,0 +1,75 @@
+#include "client_table.h"
+#include <utility>
+
+ClientHandle ClientTable::insert(const Client &client) {
+  uint32_t slot;
+  if (!free_slots_.empty()) {
+    slot = free_slots_.back();
+    free_slots_.pop_back();
+  } else {
+    slot = static_cast<uint32_t>(slots_.size());
+    slots_.push_back({0, 0});
+  }
+
+  slots_[slot].dense = static_cast<uint32_t>(dense_.size());
+  dense_.push_back(client);
+  dense_to_slot_.push_back(slot);
+
+  ClientHandle handle{slot, slots_[slot].generation};
+  index_[client.frame] = {handle, WindowRole::Frame};
+  index_[client.titlebar] = {handle, WindowRole::Titlebar};
+  index_[client.window] = {handle, WindowRole::Client};
+  return handle;
+}
+
+void ClientTable::erase(ClientHandle handle) {
+  if (!get(handle))
+    return;
+
+  uint32_t hole = slots_[handle.slot].dense;
+  Client &c = dense_[hole];
+  index_.erase(c.frame);
+  index_.erase(c.titlebar);
+  index_.erase(c.window);
+
+  uint32_t last = static_cast<uint32_t>(dense_.size() - 1);
+  if (hole != last) {
+    dense_[hole] = std::move(dense_[last]);
+    dense_to_slot_[hole] = dense_to_slot_[last];
+    slots_[dense_to_slot_[hole]].dense = hole;
+  }
+  dense_.pop_back();
+  dense_to_slot_.pop_back();
+
+  slots_[handle.slot].generation++;
+  free_slots_.push_back(handle.slot);
+}
+
+Client *ClientTable::get(ClientHandle handle) {
+  if (handle.slot >= slots_.size() ||
+      slots_[handle.slot].generation != handle.generation)
+    return nullptr;
+  return &dense_[slots_[handle.slot].dense];
+}
+
+ClientHandle ClientTable::handle_of(xcb_window_t window) const {
+  auto it = index_.find(window);
+  if (it == index_.end())
+    return {};
+  return it->second.handle;
+}
+
+Client *ClientTable::lookup(xcb_window_t window, WindowRole *role) {
+  auto it = index_.find(window);
+  if (it == index_.end())
+    return nullptr;
+  if (role)
+    *role = it->second.role;
+  return get(it->second.handle);
+}
+
+Client *ClientTable::find(xcb_window_t window) {
+  WindowRole role;
+  Client *c = lookup(window, &role);
+  return (c && role == WindowRole::Client) ? c : nullptr;
+}
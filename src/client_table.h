@@ -0,0 +1,51 @@
+#pragma once
+
+#include "client.h"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <xcb/xcb.h>
+
+// Which of a client's windows an X window id refers to.
+enum class WindowRole : uint8_t { Frame, Titlebar, Client };
+
+// Slot map of clients with a window id index over frame, titlebar and
+// client windows. Clients are stored densely, so iteration walks a flat
+// array; erasing swaps the last client into the hole, which means Client
+// pointers are only valid until the next insert or erase.
+class ClientTable {
+public:
+  ClientHandle insert(const Client &client);
+  void erase(ClientHandle handle);
+
+  Client *get(ClientHandle handle);
+  ClientHandle handle_of(xcb_window_t window) const;
+
+  // Resolves any of the three window ids, optionally reporting the role.
+  Client *lookup(xcb_window_t window, WindowRole *role = nullptr);
+  // Resolves only the managed client window id.
+  Client *find(xcb_window_t window);
+
+  size_t size() const { return dense_.size(); }
+  bool empty() const { return dense_.empty(); }
+
+  std::vector<Client>::iterator begin() { return dense_.begin(); }
+  std::vector<Client>::iterator end() { return dense_.end(); }
+
+private:
+  struct Slot {
+    uint32_t dense;
+    uint32_t generation;
+  };
+
+  struct IndexEntry {
+    ClientHandle handle;
+    WindowRole role;
+  };
+
+  std::vector<Client> dense_;
+  std::vector<uint32_t> dense_to_slot_;
+  std::vector<Slot> slots_;
+  std::vector<uint32_t> free_slots_;
+  std::unordered_map<xcb_window_t, IndexEntry> index_;
+};
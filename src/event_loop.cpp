@@ -0,0 +1,153 @@
+#include "event_loop.h"
+#include "log.h"
+#include <cerrno>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+EventLoop::EventLoop() {
+  sigemptyset(&signals_);
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  signal_fd_ = signalfd(-1, &signals_, SFD_NONBLOCK | SFD_CLOEXEC);
+
+  if (!is_valid()) {
+    LOG_ERROR("Failed to set up the event loop");
+    return;
+  }
+
+  watch_fd(timer_fd_, [this]() { run_timers(); });
+  watch_fd(signal_fd_, [this]() { read_signals(); });
+}
+
+EventLoop::~EventLoop() {
+  if (signal_fd_ >= 0)
+    close(signal_fd_);
+  if (timer_fd_ >= 0)
+    close(timer_fd_);
+  if (epoll_fd_ >= 0)
+    close(epoll_fd_);
+}
+
+bool EventLoop::is_valid() const {
+  return epoll_fd_ >= 0 && timer_fd_ >= 0 && signal_fd_ >= 0;
+}
+
+bool EventLoop::watch_fd(int fd, Callback cb) {
+  epoll_event ev = {};
+  ev.events = EPOLLIN;
+  ev.data.fd = fd;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0)
+    return false;
+  fds_[fd] = std::move(cb);
+  return true;
+}
+
+void EventLoop::unwatch_fd(int fd) {
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+  fds_.erase(fd);
+}
+
+bool EventLoop::watch_signal(int signo, Callback cb) {
+  sigaddset(&signals_, signo);
+  if (sigprocmask(SIG_BLOCK, &signals_, nullptr) < 0 ||
+      signalfd(signal_fd_, &signals_, 0) < 0)
+    return false;
+  signal_handlers_[signo] = std::move(cb);
+  return true;
+}
+
+EventLoop::TimerId EventLoop::add_timer(Clock::duration delay, Callback cb) {
+  TimerId id = next_timer_++;
+  Clock::time_point deadline = Clock::now() + delay;
+  timers_[{deadline, id}] = std::move(cb);
+  timer_deadlines_[id] = deadline;
+  arm_timer();
+  return id;
+}
+
+void EventLoop::cancel_timer(TimerId id) {
+  auto it = timer_deadlines_.find(id);
+  if (it == timer_deadlines_.end())
+    return;
+  timers_.erase({it->second, id});
+  timer_deadlines_.erase(it);
+  arm_timer();
+}
+
+void EventLoop::set_idle(Callback cb) { idle_ = std::move(cb); }
+
+// Points the timerfd at the earliest deadline, or disarms it.
+void EventLoop::arm_timer() {
+  itimerspec spec = {};
+  if (!timers_.empty()) {
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  timers_.begin()->first.first.time_since_epoch())
+                  .count();
+    // An all-zero it_value would disarm the timer.
+    if (ns <= 0)
+      ns = 1;
+    spec.it_value.tv_sec = ns / 1000000000;
+    spec.it_value.tv_nsec = ns % 1000000000;
+  }
+  timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &spec, nullptr);
+}
+
+void EventLoop::run_timers() {
+  uint64_t expirations;
+  while (read(timer_fd_, &expirations, sizeof(expirations)) > 0) {
+  }
+
+  Clock::time_point now = Clock::now();
+  while (!timers_.empty() && timers_.begin()->first.first <= now) {
+    auto it = timers_.begin();
+    Callback cb = std::move(it->second);
+    timer_deadlines_.erase(it->first.second);
+    timers_.erase(it);
+    cb();
+  }
+  arm_timer();
+}
+
+void EventLoop::read_signals() {
+  signalfd_siginfo info;
+  while (read(signal_fd_, &info, sizeof(info)) == sizeof(info)) {
+    auto it = signal_handlers_.find(static_cast<int>(info.ssi_signo));
+    if (it != signal_handlers_.end())
+      it->second();
+  }
+}
+
+void EventLoop::run() {
+  running_ = true;
+
+  // Whatever was queued before the first wait.
+  if (idle_)
+    idle_();
+
+  while (running_) {
+    epoll_event events[16];
+    int n = epoll_wait(epoll_fd_, events, 16, -1);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      LOG_ERROR("epoll_wait failed");
+      break;
+    }
+
+    for (int i = 0; i < n && running_; i++) {
+      auto it = fds_.find(events[i].data.fd);
+      if (it == fds_.end())
+        continue;
+      // Copied so the callback may unwatch its own fd.
+      Callback cb = it->second;
+      cb();
+    }
+
+    if (running_ && idle_)
+      idle_();
+  }
+}
+
+void EventLoop::stop() { running_ = false; }
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <unordered_map>
+#include <utility>
+
+// epoll-based loop multiplexing file descriptors, timers (one timerfd) and
+// signals (one signalfd). After every wakeup, once the ready callbacks have
+// run, the idle callback runs; the WM uses it to end its event batch.
+class EventLoop {
+public:
+  using Callback = std::function<void()>;
+  using Clock = std::chrono::steady_clock;
+  using TimerId = uint64_t;
+
+  EventLoop();
+  ~EventLoop();
+
+  EventLoop(const EventLoop &) = delete;
+  EventLoop &operator=(const EventLoop &) = delete;
+
+  bool is_valid() const;
+
+  // Calls cb whenever fd is readable (or hung up).
+  bool watch_fd(int fd, Callback cb);
+  void unwatch_fd(int fd);
+
+  // Blocks normal delivery of signo and calls cb from the loop instead.
+  bool watch_signal(int signo, Callback cb);
+
+  // One-shot timer; returns an id usable with cancel_timer. Ids are never
+  // 0, so 0 can mean "no timer".
+  TimerId add_timer(Clock::duration delay, Callback cb);
+  void cancel_timer(TimerId id);
+
+  void set_idle(Callback cb);
+
+  void run();
+  void stop();
+
+private:
+  void arm_timer();
+  void run_timers();
+  void read_signals();
+
+  int epoll_fd_ = -1;
+  int timer_fd_ = -1;
+  int signal_fd_ = -1;
+  sigset_t signals_;
+  bool running_ = false;
+
+  std::unordered_map<int, Callback> fds_;
+  std::unordered_map<int, Callback> signal_handlers_;
+  std::map<std::pair<Clock::time_point, TimerId>, Callback> timers_;
+  std::unordered_map<TimerId, Clock::time_point> timer_deadlines_;
+  TimerId next_timer_ = 1;
+  Callback idle_;
+};
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+
+// The core protocol's name for an event type (the response_type without
+// the synthetic bit), or nullptr for extension events.
+inline const char *event_name(uint8_t type) {
+  static const char *const names[] = {
+      "Error",            "Reply",            "KeyPress",
+      "KeyRelease",       "ButtonPress",      "ButtonRelease",
+      "MotionNotify",     "EnterNotify",      "LeaveNotify",
+      "FocusIn",          "FocusOut",         "KeymapNotify",
+      "Expose",           "GraphicsExpose",   "NoExposure",
+      "VisibilityNotify", "CreateNotify",     "DestroyNotify",
+      "UnmapNotify",      "MapNotify",        "MapRequest",
+      "ReparentNotify",   "ConfigureNotify",  "ConfigureRequest",
+      "GravityNotify",    "ResizeRequest",    "CirculateNotify",
+      "CirculateRequest", "PropertyNotify",   "SelectionClear",
+      "SelectionRequest", "SelectionNotify",  "ColormapNotify",
+      "ClientMessage",    "MappingNotify",    "GenericEvent",
+  };
+  return type < sizeof(names) / sizeof(names[0]) ? names[type] : nullptr;
+}
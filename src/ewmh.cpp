@@ -0,0 +1,131 @@
+#include "ewmh.h"
+#include <algorithm>
+#include <cstring>
+
+void EwmhRoot::init(xcb_connection_t *conn, const Atoms &atoms,
+                    xcb_window_t root, int desktops) {
+  atoms_ = &atoms;
+  root_ = root;
+
+  check_window_ = xcb_generate_id(conn);
+  xcb_create_window(conn, XCB_COPY_FROM_PARENT, check_window_, root, -1, -1,
+                    1, 1, 0, XCB_WINDOW_CLASS_INPUT_ONLY,
+                    XCB_COPY_FROM_PARENT, 0, nullptr);
+  for (xcb_window_t window : {root, check_window_}) {
+    xcb_change_property(conn, XCB_PROP_MODE_REPLACE, window,
+                        atoms.net_supporting_wm_check, XCB_ATOM_WINDOW, 32, 1,
+                        &check_window_);
+  }
+  const char *name = "wm";
+  xcb_change_property(conn, XCB_PROP_MODE_REPLACE, check_window_,
+                      atoms.net_wm_name, atoms.utf8_string, 8, strlen(name),
+                      name);
+
+  xcb_atom_t supported[] = {
+      atoms.net_supported,          atoms.net_supporting_wm_check,
+      atoms.net_client_list,        atoms.net_client_list_stacking,
+      atoms.net_active_window,      atoms.net_close_window,
+      atoms.net_wm_state,           atoms.net_wm_state_fullscreen,
+      atoms.net_number_of_desktops, atoms.net_current_desktop,
+      atoms.net_wm_desktop,         atoms.net_wm_name,
+  };
+  xcb_change_property(conn, XCB_PROP_MODE_REPLACE, root, atoms.net_supported,
+                      XCB_ATOM_ATOM, 32,
+                      sizeof(supported) / sizeof(supported[0]), supported);
+
+  uint32_t count = desktops;
+  xcb_change_property(conn, XCB_PROP_MODE_REPLACE, root,
+                      atoms.net_number_of_desktops, XCB_ATOM_CARDINAL, 32, 1,
+                      &count);
+
+  // Whatever a previous WM left behind does not describe our clients.
+  // Start from empty lists so the caches match the root.
+  xcb_delete_property(conn, root, atoms.net_client_list);
+  xcb_delete_property(conn, root, atoms.net_client_list_stacking);
+  sent_clients_.clear();
+  sent_stacking_.clear();
+  sent_active_ = XCB_NONE;
+  xcb_change_property(conn, XCB_PROP_MODE_REPLACE, root,
+                      atoms.net_active_window, XCB_ATOM_WINDOW, 32, 1,
+                      &sent_active_);
+  sent_desktop_ = -1;
+  dirty_ = EWMH_CLIENT_LIST | EWMH_STACKING | EWMH_ACTIVE | EWMH_DESKTOP;
+}
+
+void EwmhRoot::release(xcb_connection_t *conn) {
+  if (check_window_ != XCB_NONE)
+    xcb_destroy_window(conn, check_window_);
+  check_window_ = XCB_NONE;
+}
+
+void EwmhRoot::flush(xcb_connection_t *conn, ClientTable &clients,
+                     const ClientList &client_order,
+                     const ClientList &stacking,
+                     xcb_window_t focused_window, int desktop) {
+  if (!dirty_)
+    return;
+
+  auto add = [this](const Client &c) { scratch_.push_back(c.window); };
+  if (dirty_ & EWMH_CLIENT_LIST) {
+    scratch_.clear();
+    client_order.for_each(clients, add);
+    update_list(conn, atoms_->net_client_list, sent_clients_, scratch_);
+  }
+
+  if (dirty_ & EWMH_STACKING) {
+    scratch_.clear();
+    stacking.for_each(clients, add);
+    update_list(conn, atoms_->net_client_list_stacking, sent_stacking_,
+                scratch_);
+  }
+
+  if ((dirty_ & EWMH_ACTIVE) && focused_window != sent_active_) {
+    xcb_change_property(conn, XCB_PROP_MODE_REPLACE, root_,
+                        atoms_->net_active_window, XCB_ATOM_WINDOW, 32, 1,
+                        &focused_window);
+    sent_active_ = focused_window;
+  }
+
+  if ((dirty_ & EWMH_DESKTOP) && desktop != sent_desktop_) {
+    uint32_t value = desktop;
+    xcb_change_property(conn, XCB_PROP_MODE_REPLACE, root_,
+                        atoms_->net_current_desktop, XCB_ATOM_CARDINAL, 32, 1,
+                        &value);
+    sent_desktop_ = desktop;
+  }
+
+  dirty_ = 0;
+}
+
+void EwmhRoot::update_list(xcb_connection_t *conn, xcb_atom_t atom,
+                           std::vector<xcb_window_t> &sent,
+                           const std::vector<xcb_window_t> &now) {
+  if (now == sent)
+    return;
+
+  if (now.size() > sent.size() &&
+      std::equal(sent.begin(), sent.end(), now.begin())) {
+    xcb_change_property(conn, XCB_PROP_MODE_APPEND, root_, atom,
+                        XCB_ATOM_WINDOW, 32, now.size() - sent.size(),
+                        now.data() + sent.size());
+  } else {
+    xcb_change_property(conn, XCB_PROP_MODE_REPLACE, root_, atom,
+                        XCB_ATOM_WINDOW, 32, now.size(), now.data());
+  }
+  sent = now;
+}
+
+void set_wm_state(xcb_connection_t *conn, const Atoms &atoms,
+                  const Client &c) {
+  xcb_change_property(conn, XCB_PROP_MODE_REPLACE, c.window,
+                      atoms.net_wm_state, XCB_ATOM_ATOM, 32,
+                      c.fullscreen ? 1 : 0, &atoms.net_wm_state_fullscreen);
+}
+
+void set_wm_desktop(xcb_connection_t *conn, const Atoms &atoms,
+                    const Client &c) {
+  uint32_t desktop = c.workspace;
+  xcb_change_property(conn, XCB_PROP_MODE_REPLACE, c.window,
+                      atoms.net_wm_desktop, XCB_ATOM_CARDINAL, 32, 1,
+                      &desktop);
+}
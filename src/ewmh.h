@@ -0,0 +1,62 @@
+#pragma once
+
+#include "atoms.h"
+#include "client_list.h"
+#include "client_table.h"
+#include <cstdint>
+#include <vector>
+#include <xcb/xcb.h>
+
+// Root properties that need rewriting.
+enum : uint8_t {
+  EWMH_CLIENT_LIST = 1 << 0,
+  EWMH_STACKING = 1 << 1,
+  EWMH_ACTIVE = 1 << 2,
+  EWMH_DESKTOP = 1 << 3,
+};
+
+// EWMH state on the root window. Changes are only marked as they happen;
+// flush() writes what changed once per event batch. A list that only grew
+// at the end is sent as an append of the new windows, and a value equal
+// to the last one written is not sent at all.
+class EwmhRoot {
+public:
+  // Creates the _NET_SUPPORTING_WM_CHECK window and sets the static root
+  // properties.
+  void init(xcb_connection_t *conn, const Atoms &atoms, xcb_window_t root,
+            int desktops);
+
+  // Destroys the check window, for a restart: its successor makes its own.
+  void release(xcb_connection_t *conn);
+
+  void mark(uint8_t what) { dirty_ |= what; }
+
+  // client_order and stacking are lists of client_order and stack links.
+  void flush(xcb_connection_t *conn, ClientTable &clients,
+             const ClientList &client_order, const ClientList &stacking,
+             xcb_window_t focused_window, int desktop);
+
+private:
+  void update_list(xcb_connection_t *conn, xcb_atom_t atom,
+                   std::vector<xcb_window_t> &sent,
+                   const std::vector<xcb_window_t> &now);
+
+  const Atoms *atoms_ = nullptr;
+  xcb_window_t root_ = XCB_NONE;
+  xcb_window_t check_window_ = XCB_NONE;
+  uint8_t dirty_ = 0;
+
+  std::vector<xcb_window_t> sent_clients_;
+  std::vector<xcb_window_t> sent_stacking_;
+  std::vector<xcb_window_t> scratch_;
+  xcb_window_t sent_active_ = XCB_NONE;
+  int sent_desktop_ = -1;
+};
+
+// Writes c's _NET_WM_STATE (only FULLSCREEN is supported).
+void set_wm_state(xcb_connection_t *conn, const Atoms &atoms,
+                  const Client &c);
+
+// Writes c's _NET_WM_DESKTOP.
+void set_wm_desktop(xcb_connection_t *conn, const Atoms &atoms,
+                    const Client &c);
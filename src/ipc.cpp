@@ -0,0 +1,156 @@
+#include "ipc.h"
+#include "log.h"
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <utility>
+
+namespace {
+
+// A client that sends this much without a newline is not speaking the
+// protocol.
+constexpr size_t MAX_LINE = 64 * 1024;
+
+} // namespace
+
+IpcServer::IpcServer(EventLoop &loop, Handler handler)
+    : loop_(loop), handler_(std::move(handler)) {}
+
+IpcServer::~IpcServer() {
+  while (!inputs_.empty())
+    close_client(inputs_.begin()->first);
+  if (listen_fd_ >= 0) {
+    loop_.unwatch_fd(listen_fd_);
+    close(listen_fd_);
+    unlink(path_.c_str());
+  }
+}
+
+bool IpcServer::listen(const std::string &path) {
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    LOG_ERROR("IPC socket path too long: %s", path.c_str());
+    return false;
+  }
+  memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+  listen_fd_ =
+      socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (listen_fd_ < 0) {
+    LOG_ERROR("Failed to create IPC socket: %s", strerror(errno));
+    return false;
+  }
+
+  unlink(path.c_str());
+  if (bind(listen_fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) <
+          0 ||
+      ::listen(listen_fd_, 16) < 0) {
+    LOG_ERROR("Failed to listen on %s: %s", path.c_str(), strerror(errno));
+    close(listen_fd_);
+    listen_fd_ = -1;
+    return false;
+  }
+
+  path_ = path;
+  loop_.watch_fd(listen_fd_, [this]() { accept_clients(); });
+  LOG_INFO("IPC listening on %s", path.c_str());
+  return true;
+}
+
+void IpcServer::accept_clients() {
+  int fd;
+  while ((fd = accept4(listen_fd_, nullptr, nullptr,
+                       SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+    inputs_[fd];
+    loop_.watch_fd(fd, [this, fd]() { read_client(fd); });
+  }
+}
+
+void IpcServer::read_client(int fd) {
+  auto it = inputs_.find(fd);
+  if (it == inputs_.end())
+    return;
+  std::string &input = it->second;
+
+  bool eof = false;
+  char buf[4096];
+  while (true) {
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n > 0) {
+      input.append(buf, n);
+      continue;
+    }
+    if (n < 0 && errno == EINTR)
+      continue;
+    // Hang-ups and errors both end the session once this batch is done.
+    if (n == 0 || errno != EAGAIN)
+      eof = true;
+    break;
+  }
+
+  std::string reply;
+  size_t start = 0;
+  size_t end;
+  while ((end = input.find('\n', start)) != std::string::npos) {
+    run_line(input.substr(start, end - start), reply);
+    start = end + 1;
+  }
+  input.erase(0, start);
+
+  // A last command without a trailing newline still counts.
+  if (eof && !input.empty()) {
+    run_line(input, reply);
+    input.clear();
+  }
+
+  if (!eof && input.size() > MAX_LINE) {
+    LOG_WARN("IPC client sent an overlong line; disconnecting");
+    close_client(fd);
+    return;
+  }
+
+  size_t written = 0;
+  while (written < reply.size()) {
+    ssize_t n = send(fd, reply.data() + written, reply.size() - written,
+                     MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0) {
+      // Replies are never queued: a client that does not read them must
+      // not be able to grow the WM's memory or stall the loop.
+      if (!eof)
+        LOG_WARN("IPC client is not reading replies; disconnecting");
+      eof = true;
+      break;
+    }
+    written += n;
+  }
+
+  if (eof)
+    close_client(fd);
+}
+
+void IpcServer::run_line(const std::string &line, std::string &reply) {
+  std::istringstream words(line);
+  std::vector<std::string> args;
+  for (std::string word; words >> word;)
+    args.push_back(word);
+  if (args.empty())
+    return;
+
+  std::string error = handler_(args, reply);
+  if (error.empty())
+    reply += "ok\n";
+  else
+    reply += "error " + error + "\n";
+}
+
+void IpcServer::close_client(int fd) {
+  loop_.unwatch_fd(fd);
+  close(fd);
+  inputs_.erase(fd);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "event_loop.h"
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Line-oriented control socket (--ipc PATH). Each line is one command,
+// split on whitespace. The reply to a command is any number of data lines
+// followed by "ok" or "error <message>".
+//
+// Everything a client has sent by the time its socket is read is run as
+// one batch and the replies go back in one write. The WM flushes X once
+// per loop wakeup, so a script that pipes in many commands at once costs
+// one flush rather than one per command.
+class IpcServer {
+public:
+  // Runs one command. Appends data lines to out and returns an error
+  // message, or an empty string on success.
+  using Handler = std::function<std::string(
+      const std::vector<std::string> &args, std::string &out)>;
+
+  IpcServer(EventLoop &loop, Handler handler);
+  ~IpcServer();
+
+  IpcServer(const IpcServer &) = delete;
+  IpcServer &operator=(const IpcServer &) = delete;
+
+  // Binds path (replacing a stale socket) and starts accepting.
+  bool listen(const std::string &path);
+
+private:
+  void accept_clients();
+  void read_client(int fd);
+  void run_line(const std::string &line, std::string &reply);
+  void close_client(int fd);
+
+  EventLoop &loop_;
+  Handler handler_;
+  int listen_fd_ = -1;
+  std::string path_;
+  std::unordered_map<int, std::string> inputs_; // partial lines per client
+};
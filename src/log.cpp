@@ -0,0 +1,113 @@
+#include "log.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdio>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr size_t LOG_SLOTS = 1024; // power of two
+constexpr size_t LOG_LINE = 256;
+constexpr int DRAIN_IOV = 64;
+
+struct LogSlot {
+  LogLevel level;
+  size_t length;
+  char text[LOG_LINE];
+};
+
+// Single-producer ring: log_write only advances head, log_drain only
+// advances tail, so neither side needs a lock.
+LogSlot ring[LOG_SLOTS];
+std::atomic<size_t> head{0};
+std::atomic<size_t> tail{0};
+std::atomic<size_t> dropped{0};
+
+const char *const level_tags[] = {"[debug] ", "[info] ", "[warn] ",
+                                  "[error] "};
+
+int fd_for(LogLevel level) {
+  return level >= LogLevel::Warn ? STDERR_FILENO : STDOUT_FILENO;
+}
+
+void write_all(int fd, iovec *iov, int count) {
+  while (count > 0) {
+    ssize_t n = writev(fd, iov, count);
+    if (n < 0)
+      return;
+    while (count > 0 && static_cast<size_t>(n) >= iov->iov_len) {
+      n -= iov->iov_len;
+      iov++;
+      count--;
+    }
+    if (count > 0) {
+      iov->iov_base = static_cast<char *>(iov->iov_base) + n;
+      iov->iov_len -= n;
+    }
+  }
+}
+
+} // namespace
+
+void log_write(LogLevel level, const char *fmt, ...) {
+  size_t h = head.load(std::memory_order_relaxed);
+  if (h - tail.load(std::memory_order_acquire) == LOG_SLOTS) {
+    dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  LogSlot &slot = ring[h & (LOG_SLOTS - 1)];
+  size_t prefix = snprintf(slot.text, LOG_LINE, "%s",
+                           level_tags[static_cast<int>(level)]);
+
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(slot.text + prefix, LOG_LINE - prefix - 1, fmt, args);
+  va_end(args);
+
+  size_t length = prefix;
+  if (n > 0)
+    length += std::min(static_cast<size_t>(n), LOG_LINE - prefix - 2);
+  slot.text[length++] = '\n';
+  slot.length = length;
+  slot.level = level;
+
+  head.store(h + 1, std::memory_order_release);
+}
+
+void log_drain() {
+  size_t t = tail.load(std::memory_order_relaxed);
+  size_t h = head.load(std::memory_order_acquire);
+
+  // Consecutive lines bound for the same fd go out in one writev.
+  while (t != h) {
+    iovec iov[DRAIN_IOV];
+    int count = 0;
+    int fd = fd_for(ring[t & (LOG_SLOTS - 1)].level);
+
+    while (t != h && count < DRAIN_IOV) {
+      LogSlot &slot = ring[t & (LOG_SLOTS - 1)];
+      if (fd_for(slot.level) != fd)
+        break;
+      iov[count].iov_base = slot.text;
+      iov[count].iov_len = slot.length;
+      count++;
+      t++;
+    }
+
+    write_all(fd, iov, count);
+    tail.store(t, std::memory_order_release);
+  }
+
+  size_t lost = dropped.exchange(0, std::memory_order_relaxed);
+  if (lost) {
+    char line[64];
+    int n = snprintf(line, sizeof(line), "[warn] %zu log lines dropped\n",
+                     lost);
+    iovec iov = {line, static_cast<size_t>(n)};
+    write_all(STDERR_FILENO, &iov, 1);
+  }
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+enum class LogLevel { Debug, Info, Warn, Error };
+
+// Formats a line into the in-memory log ring. Never blocks and never
+// touches a file descriptor; if the ring is full the line is dropped and
+// counted. Must only be called from the event loop thread.
+void log_write(LogLevel level, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+// Writes out everything queued so far with as few syscalls as possible.
+// The event loop calls this when it is about to go idle.
+void log_drain();
+
+// Debug logging is compiled out of release (NDEBUG) builds: the call is
+// dead code, so arguments are never evaluated, but the format string is
+// still type checked.
+#ifdef NDEBUG
+#define LOG_DEBUG(...)                                                         \
+  do {                                                                         \
+    if (false)                                                                 \
+      log_write(LogLevel::Debug, __VA_ARGS__);                                 \
+  } while (0)
+#else
+#define LOG_DEBUG(...) log_write(LogLevel::Debug, __VA_ARGS__)
+#endif
+
+#define LOG_INFO(...) log_write(LogLevel::Info, __VA_ARGS__)
+#define LOG_WARN(...) log_write(LogLevel::Warn, __VA_ARGS__)
+#define LOG_ERROR(...) log_write(LogLevel::Error, __VA_ARGS__)
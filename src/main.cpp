@@ -1,10 +1,33 @@
+#include "atoms.h"
+#include "client_list.h"
+#include "client_table.h"
+#include "event_loop.h"
+#include "ewmh.h"
+#include "ipc.h"
+#include "log.h"
+#include "monitors.h"
+#include "placement.h"
+#include "resize_sync.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "tiling.h"
+#include "trace.h"
+#include "x_errors.h"
 #include "xconnection.h"
 #include <X11/keysym.h>
 #include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <csignal>
 #include <cstdint>
-#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <functional>
+#include <memory>
+#include <sys/mman.h>
 #include <unistd.h>
-#include <unordered_map>
+#include <utility>
 #include <vector>
 #include <xcb/xcb.h>
 #include <xcb/xcb_cursor.h>
@@ -12,16 +35,6 @@
 #include <xcb/xcb_keysyms.h>
 #include <xcb/xproto.h>
 
-struct Client {
-  xcb_window_t frame;
-  xcb_window_t titlebar;
-  xcb_window_t window;
-  xcb_gcontext_t titlebar_gc;
-  int x, y;
-  int width, height;
-  std::string title;
-};
-
 struct DragState {
   bool active = false;
   xcb_window_t frame = XCB_NONE;
@@ -31,6 +44,15 @@ struct DragState {
   int start_y = 0;
 };
 
+// Per-workspace layout state. Windows on hidden workspaces keep their
+// space reserved, so switching back never re-places anything.
+struct Workspace {
+  Placement placement;
+  ClientList focus{&Client::focus_link}; // most recent first
+  std::vector<BspLayout> tiling; // one tree per monitor
+  xcb_window_t focused_window = XCB_NONE; // restored on switching back
+};
+
 enum ResizeEdge {
   RESIZE_NONE = 0,
   RESIZE_LEFT = 1 << 0,
@@ -58,45 +80,68 @@ struct ResizeState {
   int start_y = 0;
   int start_w = 0;
   int start_h = 0;
+
+  // Latest geometry computed from motion that has not been sent yet.
+  bool pending = false;
+  int x = 0, y = 0, w = 0, h = 0;
+  xcb_timestamp_t time = XCB_CURRENT_TIME;
+  std::chrono::steady_clock::time_point last_sent;
+
+  // A _NET_WM_SYNC_REQUEST is waiting for the client's counter update.
+  bool sync_pending = false;
+  std::chrono::steady_clock::time_point sync_sent;
+
+  // Retries a resize held back by pacing.
+  EventLoop::TimerId timer = 0;
+};
+
+// An Alt+Tab session: while Alt is held, each Tab focuses the next client
+// in the workspace's focus list, and the list is only reordered once Alt
+// is released, so n presses reach the n-th most recent client.
+struct FocusCycle {
+  bool active = false;
+  ClientHandle current;
 };
 
 static const int RESIZE_BORDER = 10;
+static const int FRAME_BORDER = 10;
 static const int MIN_WIDTH = 100;
 static const int MIN_HEIGHT = 80;
 static const int TITLE_HEIGHT = 24;
 static const int gap = 20;
+static const int MAX_EVENTS_BEFORE_MANAGE = 64;
+static const int PIXMAP_WIDTH_STEP = 256;
+static const int NUM_WORKSPACES = 9;
+// How much of a dragged frame has to stay on the pointer's monitor.
+static const int DRAG_MIN_VISIBLE = 40;
+
+// Clients without _NET_WM_SYNC_REQUEST are resized at most this often.
+static const std::chrono::milliseconds RESIZE_INTERVAL(1000 / 60);
+// A sync client that has not answered within this time is resized anyway.
+static const std::chrono::milliseconds SYNC_TIMEOUT(100);
+// How long a client asked to close may take before it is killed.
+static const std::chrono::seconds CLOSE_TIMEOUT(5);
 
 static const uint32_t COLOR_ACTIVE = 0x005577FF;
 static const uint32_t COLOR_INACTIVE = 0x333333FF;
 static const uint32_t COLOR_TEXT = 0xFFFFFFFF;
 
-static int next_x = 50;
-static int next_y = 50;
-static int row_height = 0;
-
-std::string get_window_title(xcb_connection_t *conn, xcb_window_t win) {
-
-  xcb_intern_atom_cookie_t name_cookie =
-      xcb_intern_atom(conn, 0, 12, "_NET_WM_NAME");
-
-  xcb_intern_atom_reply_t *name_reply =
-      xcb_intern_atom_reply(conn, name_cookie, nullptr);
-
-  if (!name_reply) {
-    name_cookie = xcb_intern_atom(conn, 0, 7, "WM_NAME");
-    name_reply = xcb_intern_atom_reply(conn, name_cookie, nullptr);
-    if (!name_reply)
-      return "";
-  }
-
-  xcb_atom_t name_atom = name_reply->atom;
-  free(name_reply);
+// Title requests for both name properties, sent together.
+struct TitleCookies {
+  xcb_get_property_cookie_t net_wm_name;
+  xcb_get_property_cookie_t wm_name;
+};
 
-  xcb_get_property_cookie_t prop_cookie = xcb_get_property(
-      conn, 0, win, name_atom, XCB_GET_PROPERTY_TYPE_ANY, 0, 1024);
-  xcb_get_property_reply_t *prop =
-      xcb_get_property_reply(conn, prop_cookie, nullptr);
+TitleCookies request_title(xcb_connection_t *conn, const Atoms &atoms,
+                           xcb_window_t win) {
+  return {xcb_get_property(conn, 0, win, atoms.net_wm_name,
+                           XCB_GET_PROPERTY_TYPE_ANY, 0, 1024),
+          xcb_get_property(conn, 0, win, XCB_ATOM_WM_NAME,
+                           XCB_GET_PROPERTY_TYPE_ANY, 0, 1024)};
+}
 
+// Takes ownership of prop.
+std::string title_from_reply(xcb_get_property_reply_t *prop) {
   if (!prop)
     return "";
 
@@ -108,33 +153,182 @@ std::string get_window_title(xcb_connection_t *conn, xcb_window_t win) {
   }
 
   free(prop);
+  return title;
+}
 
-  std::cout << "window title: " << title << "\n" << std::endl;
+// Collects both title replies, preferring _NET_WM_NAME over WM_NAME.
+std::string title_from_replies(xcb_connection_t *conn, TitleCookies cookies) {
+  stats_round_trip();
+  std::string title = title_from_reply(
+      xcb_get_property_reply(conn, cookies.net_wm_name, nullptr));
+  stats_round_trip();
+  std::string wm_name =
+      title_from_reply(xcb_get_property_reply(conn, cookies.wm_name, nullptr));
+
+  if (title.empty())
+    title = wm_name;
+
+  LOG_DEBUG("window title: %s", title.c_str());
   return title;
 }
 
-void draw_titlebar(xcb_connection_t *conn, xcb_window_t win, xcb_gcontext_t gc,
-                   uint32_t color, const std::string &title, int width) {
-  std::cout << "Drawing titlebar for window: " << win << "\n" << std::endl;
+std::string get_window_title(xcb_connection_t *conn, const Atoms &atoms,
+                             xcb_window_t win) {
+  return title_from_replies(conn, request_title(conn, atoms, win));
+}
+
+// Replies needed before a window can be framed. The requests are all sent
+// when the MapRequest arrives and collected later in one batch.
+struct PendingManage {
+  xcb_window_t window;
+  xcb_get_window_attributes_cookie_t attr;
+  xcb_get_geometry_cookie_t geom;
+  xcb_get_property_cookie_t hints;
+  xcb_get_property_cookie_t protocols;
+  xcb_get_property_cookie_t sync_counter;
+  xcb_get_property_cookie_t state;
+  TitleCookies title;
+  // Found by the startup scan rather than a MapRequest: only managed if
+  // already viewable, and left where it is.
+  bool adopt;
+};
+
+PendingManage request_manage(xcb_connection_t *conn, const Atoms &atoms,
+                             xcb_window_t win, bool adopt = false) {
+  PendingManage p;
+  p.window = win;
+  p.adopt = adopt;
+  p.attr = xcb_get_window_attributes(conn, win);
+  p.geom = xcb_get_geometry(conn, win);
+  p.hints = xcb_icccm_get_wm_normal_hints(conn, win);
+  p.protocols = xcb_icccm_get_wm_protocols(conn, win, atoms.wm_protocols);
+  p.sync_counter =
+      xcb_get_property(conn, 0, win, atoms.net_wm_sync_request_counter,
+                       XCB_ATOM_CARDINAL, 0, 1);
+  p.state = xcb_get_property(conn, 0, win, atoms.net_wm_state, XCB_ATOM_ATOM,
+                             0, 32);
+  p.title = request_title(conn, atoms, win);
+  return p;
+}
+
+// True if the window asked to start fullscreen. Consumes the reply.
+bool fullscreen_from_reply(xcb_connection_t *conn, const Atoms &atoms,
+                           xcb_get_property_cookie_t cookie) {
+  stats_round_trip();
+  auto *prop = xcb_get_property_reply(conn, cookie, nullptr);
+  if (!prop)
+    return false;
+  bool fullscreen = false;
+  if (prop->format == 32) {
+    auto *states = static_cast<xcb_atom_t *>(xcb_get_property_value(prop));
+    int count = xcb_get_property_value_length(prop) / 4;
+    fullscreen = std::find(states, states + count,
+                           atoms.net_wm_state_fullscreen) != states + count;
+  }
+  free(prop);
+  return fullscreen;
+}
+
+// Returns the client's sync counter if it advertises _NET_WM_SYNC_REQUEST,
+// XCB_NONE otherwise, and whether it advertises WM_DELETE_WINDOW. Consumes
+// both replies.
+uint32_t sync_counter_from_replies(xcb_connection_t *conn, const Atoms &atoms,
+                                   xcb_get_property_cookie_t protocols_cookie,
+                                   xcb_get_property_cookie_t counter_cookie,
+                                   bool &supports_delete) {
+  bool supports_sync = false;
+  supports_delete = false;
+  xcb_icccm_get_wm_protocols_reply_t protocols;
+  stats_round_trip();
+  if (xcb_icccm_get_wm_protocols_reply(conn, protocols_cookie, &protocols,
+                                       nullptr)) {
+    xcb_atom_t *end = protocols.atoms + protocols.atoms_len;
+    supports_sync =
+        std::find(protocols.atoms, end, atoms.net_wm_sync_request) != end;
+    supports_delete =
+        std::find(protocols.atoms, end, atoms.wm_delete_window) != end;
+    xcb_icccm_get_wm_protocols_reply_wipe(&protocols);
+  }
+
+  uint32_t counter = XCB_NONE;
+  stats_round_trip();
+  auto *prop = xcb_get_property_reply(conn, counter_cookie, nullptr);
+  if (prop) {
+    if (supports_sync && prop->format == 32 &&
+        xcb_get_property_value_length(prop) >= 4)
+      counter = *static_cast<uint32_t *>(xcb_get_property_value(prop));
+    free(prop);
+  }
+  return counter;
+}
+
+void render_titlebar(xcb_connection_t *conn, xcb_drawable_t target,
+                     xcb_gcontext_t gc, uint32_t color,
+                     const std::string &title, int width) {
   uint32_t vals[] = {color, COLOR_TEXT};
 
   xcb_change_gc(conn, gc, XCB_GC_FOREGROUND | XCB_GC_BACKGROUND, vals);
 
   xcb_rectangle_t rect = {0, 0, static_cast<uint16_t>(width), TITLE_HEIGHT};
 
-  xcb_poly_fill_rectangle(conn, win, gc, 1, &rect);
+  xcb_poly_fill_rectangle(conn, target, gc, 1, &rect);
 
   if (!title.empty()) {
-    xcb_image_text_8(conn, title.size(), win, gc, 8, 16, title.c_str());
+    xcb_image_text_8(conn, title.size(), target, gc, 8, 16, title.c_str());
+  }
+}
+
+void free_titlebar_pixmaps(xcb_connection_t *conn, Client &c) {
+  for (xcb_pixmap_t &pixmap : c.titlebar_pixmaps) {
+    if (pixmap != XCB_NONE)
+      xcb_free_pixmap(conn, pixmap);
+    pixmap = XCB_NONE;
   }
+  c.pixmap_width = 0;
 }
 
-bool position_hints(xcb_connection_t *conn, xcb_window_t win, int &x, int &y,
-                    bool &user_specified) {
+// Renders the inactive and active titlebars of c into its pixmap cache
+// unless the cache already holds c's title at c's width or wider.
+// Pixmaps grow in PIXMAP_WIDTH_STEP increments so that a resize only
+// re-renders when it crosses a step.
+void update_titlebar_pixmaps(xcb_connection_t *conn, xcb_drawable_t root,
+                             uint8_t depth, Client &c) {
+  if (c.pixmap_width >= c.width && c.pixmap_title == c.title)
+    return;
+
+  if (c.pixmap_width < c.width) {
+    free_titlebar_pixmaps(conn, c);
+    c.pixmap_width =
+        (c.width + PIXMAP_WIDTH_STEP - 1) / PIXMAP_WIDTH_STEP *
+        PIXMAP_WIDTH_STEP;
+    for (xcb_pixmap_t &pixmap : c.titlebar_pixmaps) {
+      pixmap = xcb_generate_id(conn);
+      xcb_create_pixmap(conn, depth, pixmap, root, c.pixmap_width,
+                        TITLE_HEIGHT);
+    }
+  }
+
+  render_titlebar(conn, c.titlebar_pixmaps[0], c.titlebar_gc, COLOR_INACTIVE,
+                  c.title, c.pixmap_width);
+  render_titlebar(conn, c.titlebar_pixmaps[1], c.titlebar_gc, COLOR_ACTIVE,
+                  c.title, c.pixmap_width);
+  c.pixmap_title = c.title;
+}
+
+void draw_titlebar(xcb_connection_t *conn, xcb_drawable_t root, uint8_t depth,
+                   Client &c, bool focused) {
+  LOG_DEBUG("Drawing titlebar for window: %u", c.titlebar);
+  update_titlebar_pixmaps(conn, root, depth, c);
+  xcb_copy_area(conn, c.titlebar_pixmaps[focused ? 1 : 0], c.titlebar,
+                c.titlebar_gc, 0, 0, 0, 0, c.width, TITLE_HEIGHT);
+}
+
+bool position_hints(xcb_connection_t *conn, xcb_get_property_cookie_t cookie,
+                    int &x, int &y, bool &user_specified) {
   xcb_size_hints_t hints;
 
-  if (!xcb_icccm_get_wm_normal_hints_reply(
-          conn, xcb_icccm_get_wm_normal_hints(conn, win), &hints, nullptr)) {
+  stats_round_trip();
+  if (!xcb_icccm_get_wm_normal_hints_reply(conn, cookie, &hints, nullptr)) {
     return false;
   }
 
@@ -155,9 +349,107 @@ bool position_hints(xcb_connection_t *conn, xcb_window_t win, int &x, int &y,
   return false;
 }
 
-void set_cursor(xcb_connection_t *conn, xcb_window_t win, xcb_cursor_t cursor) {
+int frame_height(const Client &c) { return c.height + TITLE_HEIGHT; }
+
+// The space a frame takes up for placement: its outer size plus the gap
+// kept to its right and below.
+Rect placement_rect(int x, int y, int width, int frame_height) {
+  return {x, y, width + 2 * FRAME_BORDER + gap,
+          frame_height + 2 * FRAME_BORDER + gap};
+}
+
+// The frame origin and client size filling a tile, leaving half the gap
+// on every side.
+void tile_geometry(const Rect &tile, int &x, int &y, int &width,
+                   int &height) {
+  x = tile.x + gap / 2;
+  y = tile.y + gap / 2;
+  width = std::max(tile.width - gap - 2 * FRAME_BORDER, MIN_WIDTH);
+  height =
+      std::max(tile.height - gap - 2 * FRAME_BORDER - TITLE_HEIGHT, MIN_HEIGHT);
+}
+
+int edges_at(const Client &c, int root_x, int root_y) {
+  int rx = root_x - c.x;
+  int ry = root_y - c.y;
+
+  int edges = RESIZE_NONE;
+  if (rx < RESIZE_BORDER)
+    edges |= RESIZE_LEFT;
+  if (rx > c.width - RESIZE_BORDER)
+    edges |= RESIZE_RIGHT;
+  if (ry < RESIZE_BORDER)
+    edges |= RESIZE_TOP;
+  if (ry > frame_height(c) - RESIZE_BORDER)
+    edges |= RESIZE_BOTTOM;
+  return edges;
+}
+
+// Pushes the model geometry of c to the frame, titlebar and client window.
+void configure_client(xcb_connection_t *conn, const Client &c) {
+  uint32_t frame_vals[] = {
+      static_cast<uint32_t>(c.x), static_cast<uint32_t>(c.y),
+      static_cast<uint32_t>(c.width), static_cast<uint32_t>(frame_height(c))};
+  xcb_configure_window(conn, c.frame,
+                       XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y |
+                           XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT,
+                       frame_vals);
+
+  uint32_t titlebar_vals[] = {static_cast<uint32_t>(c.width)};
+  xcb_configure_window(conn, c.titlebar, XCB_CONFIG_WINDOW_WIDTH,
+                       titlebar_vals);
+
+  uint32_t client_vals[] = {static_cast<uint32_t>(c.width),
+                            static_cast<uint32_t>(c.height)};
+  xcb_configure_window(conn, c.window,
+                       XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT,
+                       client_vals);
+}
+
+void send_delete_window(xcb_connection_t *conn, const Atoms &atoms,
+                        xcb_window_t window, xcb_timestamp_t time) {
+  xcb_client_message_event_t ev = {};
+  ev.response_type = XCB_CLIENT_MESSAGE;
+  ev.format = 32;
+  ev.window = window;
+  ev.type = atoms.wm_protocols;
+  ev.data.data32[0] = atoms.wm_delete_window;
+  ev.data.data32[1] = time;
+
+  xcb_send_event(conn, 0, window, XCB_EVENT_MASK_NO_EVENT,
+                 reinterpret_cast<const char *>(&ev));
+}
+
+// Moves c directly above sibling in the bottom-to-top stacking list: to
+// the bottom when sibling is XCB_NONE, to the top when it is no frame.
+void restack(ClientTable &clients, ClientList &stacking, Client &c,
+             xcb_window_t sibling) {
+  ClientHandle handle = clients.handle_of(c.frame);
+  if (sibling == XCB_NONE) {
+    stacking.move_to_front(clients, handle);
+    return;
+  }
+
+  WindowRole role;
+  Client *below = clients.lookup(sibling, &role);
+  if (!below || role != WindowRole::Frame) {
+    stacking.move_to_back(clients, handle);
+    return;
+  }
+  ClientHandle after = clients.handle_of(sibling);
+  if (after == handle || below->stack_link.next == handle)
+    return;
+  stacking.remove(clients, handle);
+  stacking.insert_after(clients, handle, after);
+}
+
+// Sets the cursor shown over c's frame, unless it already is the one shown.
+void set_cursor(xcb_connection_t *conn, Client &c, xcb_cursor_t cursor) {
+  if (cursor == c.cursor)
+    return;
+  c.cursor = cursor;
   uint32_t cursor_vals[] = {cursor};
-  xcb_change_window_attributes(conn, win, XCB_CW_CURSOR, cursor_vals);
+  xcb_change_window_attributes(conn, c.frame, XCB_CW_CURSOR, cursor_vals);
 }
 
 xcb_cursor_t cursor_for_edges(const WMCursors &cursors, int edges) {
@@ -176,58 +468,207 @@ xcb_cursor_t cursor_for_edges(const WMCursors &cursors, int edges) {
   return cursors.normal;
 }
 
-int main() {
-  XConnection conn;
+WMCursors load_cursors(xcb_connection_t *conn, xcb_screen_t *screen) {
+  xcb_cursor_context_t *ctx;
+  xcb_cursor_context_new(conn, screen, &ctx);
+
+  WMCursors cursors;
+  cursors.normal = xcb_cursor_load_cursor(ctx, "left_ptr");
+  cursors.move = xcb_cursor_load_cursor(ctx, "fleur");
+  cursors.resize_h = xcb_cursor_load_cursor(ctx, "sb_h_double_arrow");
+  cursors.resize_v = xcb_cursor_load_cursor(ctx, "sb_v_double_arrow");
+  cursors.resize_diag1 = xcb_cursor_load_cursor(ctx, "top_left_corner");
+  cursors.resize_diag2 = xcb_cursor_load_cursor(ctx, "top_right_corner");
+
+  xcb_cursor_context_free(ctx);
+  return cursors;
+}
+
+// Frames keep showing a freed cursor until they are given another one.
+void free_cursors(xcb_connection_t *conn, const WMCursors &cursors) {
+  for (xcb_cursor_t cursor :
+       {cursors.normal, cursors.move, cursors.resize_h, cursors.resize_v,
+        cursors.resize_diag1, cursors.resize_diag2})
+    xcb_free_cursor(conn, cursor);
+}
+
+// Click-to-focus: button 1 on a client window is routed to the WM first.
+void grab_focus_click(xcb_connection_t *conn, xcb_window_t window) {
+  xcb_grab_button(conn, 0, window,
+                  XCB_EVENT_MASK_BUTTON_PRESS | XCB_EVENT_MASK_BUTTON_RELEASE,
+                  XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC, XCB_NONE, XCB_NONE,
+                  XCB_BUTTON_INDEX_1, XCB_MOD_MASK_ANY);
+}
+
+// Parses a decimal or 0x-prefixed integer argument of an IPC command.
+bool parse_long(const std::string &arg, long *value) {
+  char *end;
+  errno = 0;
+  *value = strtol(arg.c_str(), &end, 0);
+  return errno == 0 && !arg.empty() && *end == '\0';
+}
+
+// "<window> <x> <y> <width> <height> <focused> <workspace> <title>", as
+// listed over IPC.
+std::string describe_client(const Client &c, bool focused) {
+  char buf[96];
+  snprintf(buf, sizeof(buf), "0x%x %d %d %d %d %d %d ", c.window, c.x, c.y,
+           c.width, c.height, focused ? 1 : 0, c.workspace + 1);
+  std::string line = buf + c.title;
+  std::replace(line.begin(), line.end(), '\n', ' ');
+  return line + "\n";
+}
+
+int main(int argc, char **argv) {
+  std::atexit(log_drain);
+
+  // --motion-hint selects PointerMotionHint on frames: the server then sends
+  // a single motion event and waits for QueryPointer before the next one.
+  // --stats FILE enables event timing; SIGUSR1 writes it to FILE.
+  // --ipc PATH serves the control socket (see ipc.h) at PATH.
+  // --tile lays windows out as a BSP tree instead of floating them.
+  // --snapshot FD is passed by a restarting WM to its successor.
+  // --x-fd FD speaks X over an inherited, already connected socket instead
+  // of connecting to $DISPLAY (used by the benchmarks' fake server).
+  // --record FILE writes every event received to FILE (see trace.h).
+  bool motion_hint = false;
+  bool tile = false;
+  const char *ipc_path = nullptr;
+  int snapshot_fd = -1;
+  int x_fd = -1;
+  const char *record_path = nullptr;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--motion-hint")
+      motion_hint = true;
+    else if (arg == "--tile")
+      tile = true;
+    else if (arg == "--stats" && i + 1 < argc)
+      stats_enable(argv[++i]);
+    else if (arg == "--ipc" && i + 1 < argc)
+      ipc_path = argv[++i];
+    else if (arg == "--snapshot" && i + 1 < argc)
+      snapshot_fd = atoi(argv[++i]);
+    else if (arg == "--x-fd" && i + 1 < argc)
+      x_fd = atoi(argv[++i]);
+    else if (arg == "--record" && i + 1 < argc)
+      record_path = argv[++i];
+  }
+  uint32_t motion_mask = motion_hint ? XCB_EVENT_MASK_POINTER_MOTION_HINT : 0;
+  uint32_t frame_events =
+      XCB_EVENT_MASK_EXPOSURE | XCB_EVENT_MASK_BUTTON_PRESS |
+      XCB_EVENT_MASK_BUTTON_RELEASE | XCB_EVENT_MASK_POINTER_MOTION |
+      XCB_EVENT_MASK_PROPERTY_CHANGE | XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY |
+      motion_mask;
+  uint32_t titlebar_events =
+      XCB_EVENT_MASK_BUTTON_PRESS | XCB_EVENT_MASK_EXPOSURE |
+      XCB_EVENT_MASK_BUTTON_RELEASE | XCB_EVENT_MASK_POINTER_MOTION |
+      motion_mask;
+  uint32_t client_events = XCB_EVENT_MASK_PROPERTY_CHANGE;
+
+  std::unique_ptr<XConnection> conn_owner =
+      x_fd >= 0 ? std::make_unique<XConnection>(x_fd)
+                : std::make_unique<XConnection>();
+  XConnection &conn = *conn_owner;
 
   if (!conn.is_valid()) {
     return 1;
   }
 
-  std::cout << "XConnection established \n" << std::endl;
+  LOG_INFO("XConnection established");
+
+  EventLoop loop;
+  if (!loop.is_valid()) {
+    return 1;
+  }
 
   const xcb_setup_t *setup = xcb_get_setup(conn.get());
   xcb_screen_iterator_t it = xcb_setup_roots_iterator(setup);
   xcb_screen_t *screen = it.data;
 
-  std::unordered_map<xcb_window_t, Client> clients;
-  std::vector<xcb_window_t> client_order;
-  DragState drag;
-  ResizeState resize;
-  xcb_window_t focused_window = XCB_NONE;
-  WMCursors cursors;
+  LOG_INFO("Screen size: %ux%u", screen->width_in_pixels,
+           screen->height_in_pixels);
 
-  std::cout << "Screen size: " << screen->width_in_pixels << "x"
-            << screen->height_in_pixels << "\n"
-            << std::endl;
-
-  std::cout << "Root winow id: " << screen->root << "\n" << std::endl;
+  LOG_INFO("Root window id: %u", screen->root);
 
+  // Only one client can select SubstructureRedirect on the root. The
+  // request is not checked on its own: the atom replies below are a round
+  // trip anyway, after which its error, if any, is in the event queue.
   uint32_t root_events[] = {XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT |
                             XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY |
                             XCB_EVENT_MASK_KEY_PRESS};
+  ErrorDispatcher errors;
+  errors.expect(xcb_change_window_attributes(conn.get(), screen->root,
+                                             XCB_CW_EVENT_MASK, root_events),
+                Expect::SelectRoot, screen->root);
+
+  Atoms atoms;
+  if (!atoms.intern(conn.get())) {
+    LOG_ERROR("Failed to intern atoms");
+    return 1;
+  }
 
-  xcb_void_cookie_t cookie = xcb_change_window_attributes_checked(
-      conn.get(), screen->root, XCB_CW_EVENT_MASK, root_events);
-
-  xcb_generic_error_t *error = xcb_request_check(conn.get(), cookie);
-
-  if (error) {
-    std::cerr << "Failed to get the ownership of root windown\n" << std::endl;
-    free(error);
+  // Events that arrived meanwhile (a MapRequest already) are kept for the
+  // first batch.
+  std::vector<xcb_generic_event_t *> startup_events;
+  bool root_taken = false;
+  while (xcb_generic_event_t *event = xcb_poll_for_queued_event(conn.get())) {
+    PendingRequest request;
+    if (event->response_type == 0 &&
+        errors.match(reinterpret_cast<xcb_generic_error_t *>(event),
+                     request) &&
+        request.what == Expect::SelectRoot)
+      root_taken = true;
+    startup_events.push_back(event);
+  }
+  if (root_taken) {
+    LOG_ERROR("Failed to get the ownership of root window");
+    for (xcb_generic_event_t *event : startup_events)
+      free(event);
     return 1;
   }
 
-  xcb_cursor_context_t *cursor_ctx;
-  xcb_cursor_context_new(conn.get(), screen, &cursor_ctx);
+  TraceWriter trace;
+  if (record_path) {
+    TraceHeader header;
+    header.root = screen->root;
+    header.width = screen->width_in_pixels;
+    header.height = screen->height_in_pixels;
+    header.resource_id_base = setup->resource_id_base;
+    header.resource_id_mask = setup->resource_id_mask;
+    header.atoms = atoms.list();
+    if (!trace.open(record_path, header)) {
+      LOG_ERROR("Failed to create trace %s", record_path);
+      return 1;
+    }
+  }
+
+  ClientTable clients;
+  std::vector<PendingManage> pending_manage;
+  ClientList client_order(&Client::order_link);
+  ClientList stacking(&Client::stack_link); // bottom to top
+  std::vector<Workspace> workspaces(NUM_WORKSPACES);
+  int current_workspace = 0;
+  RandrExtension randr;
+  std::vector<Rect> monitors;
+  MonitorIndex monitor_index;
+  int root_width = screen->width_in_pixels;
+  int root_height = screen->height_in_pixels;
+  bool monitors_changed = false;
+  DragState drag;
+  ResizeState resize;
+  FocusCycle cycle;
+  xcb_window_t focused_window = XCB_NONE;
+
+  EwmhRoot ewmh;
+  ewmh.init(conn.get(), atoms, screen->root, NUM_WORKSPACES);
 
-  cursors.normal = xcb_cursor_load_cursor(cursor_ctx, "left_ptr");
-  cursors.move = xcb_cursor_load_cursor(cursor_ctx, "fleur");
-  cursors.resize_h = xcb_cursor_load_cursor(cursor_ctx, "sb_h_double_arrow");
-  cursors.resize_v = xcb_cursor_load_cursor(cursor_ctx, "sb_v_double_arrow");
-  cursors.resize_diag1 = xcb_cursor_load_cursor(cursor_ctx, "top_left_corner");
-  cursors.resize_diag2 = xcb_cursor_load_cursor(cursor_ctx, "top_right_corner");
+  SyncExtension sync;
+  if (!sync.init(conn.get())) {
+    LOG_WARN("XSync unavailable, resize is rate capped only");
+  }
 
-  xcb_cursor_context_free(cursor_ctx);
+  WMCursors cursors = load_cursors(conn.get(), screen);
 
   xcb_key_symbols_t *keysyms = xcb_key_symbols_alloc(conn.get());
 
@@ -240,30 +681,681 @@ int main() {
     free(codes);
   };
 
-  grab_key(XK_F4, XCB_MOD_MASK_1);
-  grab_key(XK_Tab, XCB_MOD_MASK_1);
+  auto grab_keys = [&]() {
+    grab_key(XK_F4, XCB_MOD_MASK_1);
+    grab_key(XK_Tab, XCB_MOD_MASK_1);
+    for (xcb_keysym_t sym = XK_1; sym <= XK_9; sym++) {
+      grab_key(sym, XCB_MOD_MASK_1);
+      grab_key(sym, XCB_MOD_MASK_1 | XCB_MOD_MASK_SHIFT);
+    }
+  };
+  grab_keys();
+
+  // Re-establishes the event selections and grab on an existing frame, for
+  // clients inherited from a restarting WM. The client window's selection
+  // fails for windows that died meanwhile; the error dispatcher is told to
+  // expect that.
+  auto select_client_events = [&](const Client &c) {
+    xcb_change_window_attributes(conn.get(), c.frame, XCB_CW_EVENT_MASK,
+                                 &frame_events);
+    xcb_change_window_attributes(conn.get(), c.titlebar, XCB_CW_EVENT_MASK,
+                                 &titlebar_events);
+    grab_focus_click(conn.get(), c.window);
+    errors.expect(xcb_change_window_attributes(conn.get(), c.window,
+                                               XCB_CW_EVENT_MASK,
+                                               &client_events),
+                  Expect::SelectClient, c.window);
+  };
+
+  // Frees the X resources of a client that is gone.
+  auto destroy_frame = [&](Client &c) {
+    destroy_sync_alarm(conn.get(), c);
+    workspaces[c.workspace].placement.remove(c.frame);
+    workspaces[c.workspace].tiling[c.monitor].remove(c.frame);
+    xcb_destroy_window(conn.get(), c.frame);
+    free_titlebar_pixmaps(conn.get(), c);
+    xcb_free_gc(conn.get(), c.titlebar_gc);
+  };
+
+  // The monitor a frame's center is on, or the nearest one.
+  auto monitor_of = [&](const Client &c) {
+    Rect r = placement_rect(c.x, c.y, c.width, frame_height(c));
+    return monitor_index.at(r.x + (r.width - gap) / 2,
+                            r.y + (r.height - gap) / 2);
+  };
+
+  // Takes the new monitor layout into use in one pass: rebuilds the
+  // lookup table and the per-workspace placement areas, re-tiles, and
+  // brings floating windows left off every monitor back onto the nearest.
+  // The resulting configures go out with the batch's single flush.
+  auto set_monitors = [&](std::vector<Rect> found) {
+    bool same_count = found.size() == monitors.size();
+    monitors = std::move(found);
+    monitor_index.set(monitors, root_width, root_height);
+
+    std::vector<Rect> placement_areas;
+    for (const Rect &m : monitors)
+      placement_areas.push_back(
+          {m.x + gap, m.y + gap, m.width - gap, m.height - gap});
+    for (Workspace &ws : workspaces) {
+      ws.placement.set_areas(placement_areas);
+      if (!same_count)
+        ws.tiling.assign(monitors.size(), BspLayout());
+      // Tiles are inset by half a gap on each side of the frame.
+      for (size_t i = 0; i < monitors.size(); i++) {
+        const Rect &m = monitors[i];
+        ws.tiling[i].set_area({m.x + gap / 2, m.y + gap / 2, m.width - gap,
+                               m.height - gap});
+      }
+    }
+
+    for (Client &c : clients) {
+      // Every client must name one of the new trees. Tiled ones keep
+      // theirs while the number of monitors is unchanged.
+      int monitor = monitor_of(c);
+      if (!tile || !same_count)
+        c.monitor = monitor;
+      if (tile) {
+        if (!same_count)
+          workspaces[c.workspace].tiling[monitor].insert(c.frame, XCB_NONE);
+        continue;
+      }
+
+      Rect r = placement_rect(c.x, c.y, c.width, frame_height(c));
+      if (monitor_index.covered(r.x + (r.width - gap) / 2,
+                                r.y + (r.height - gap) / 2))
+        continue;
+      const Rect &m = monitors[monitor];
+      c.x = std::max(m.x, std::min(c.x, m.x + m.width - (r.width - gap)));
+      c.y = std::max(m.y, std::min(c.y, m.y + m.height - (r.height - gap)));
+      configure_client(conn.get(), c);
+    }
+
+    LOG_INFO("Using %zu monitor(s)", monitors.size());
+  };
+
+  if (!randr.init(conn.get(), screen->root))
+    LOG_WARN("RandR 1.5 unavailable, treating the screen as one monitor");
+  set_monitors(query_monitors(conn.get(), screen->root, randr, root_width,
+                              root_height));
+
+  // Takes over from the process that exec'd us (see the restart path at the
+  // end of main). Its frames, GCs and pixmaps outlived it, so clients are
+  // rebuilt from the snapshot without querying their windows. Ones
+  // destroyed during the handover are dropped when their selection's error
+  // arrives.
+  if (snapshot_fd >= 0) {
+    Snapshot snapshot;
+    if (!snapshot_read(snapshot_fd, NUM_WORKSPACES, snapshot)) {
+      LOG_WARN("Ignoring unreadable restart snapshot");
+      snapshot = Snapshot();
+    }
+    close(snapshot_fd);
+
+    for (Client &c : snapshot.clients) {
+      // The monitor is not in the snapshot; the layout may have changed.
+      c.monitor = monitor_of(c);
+      select_client_events(c);
+      // The save-set is per connection; the predecessor's went with it.
+      xcb_change_save_set(conn.get(), XCB_SET_MODE_INSERT, c.window);
+      client_order.push_back(clients, clients.insert(c));
+      Workspace &ws = workspaces[c.workspace];
+      if (tile)
+        ws.tiling[c.monitor].insert(c.frame, XCB_NONE);
+      ws.placement.set(c.frame,
+                       placement_rect(c.x, c.y, c.width, frame_height(c)));
+    }
+
+    for (xcb_window_t frame : snapshot.stacking) {
+      ClientHandle handle = clients.handle_of(frame);
+      WindowRole role;
+      if (clients.lookup(frame, &role) && role == WindowRole::Frame &&
+          !stacking.contains(clients, handle))
+        stacking.push_back(clients, handle);
+    }
+    for (xcb_window_t window : snapshot.focus_order) {
+      ClientHandle handle = clients.handle_of(window);
+      Client *c = clients.find(window);
+      if (c && !workspaces[c->workspace].focus.contains(clients, handle))
+        workspaces[c->workspace].focus.push_back(clients, handle);
+    }
+    // A snapshot that leaves clients out of either order still lists them.
+    for (Client &c : clients) {
+      ClientHandle handle = clients.handle_of(c.window);
+      if (!stacking.contains(clients, handle))
+        stacking.push_back(clients, handle);
+      if (!workspaces[c.workspace].focus.contains(clients, handle))
+        workspaces[c.workspace].focus.push_back(clients, handle);
+    }
+    if (clients.find(snapshot.focused_window))
+      focused_window = snapshot.focused_window;
+    current_workspace = snapshot.current_workspace;
+
+    LOG_INFO("Restored %zu clients", clients.size());
+  }
+
+  // Windows mapped before we took over never send a MapRequest. Queue them
+  // as if they had; the first batch then collects the replies for all of
+  // them at once, so adopting hundreds of windows costs two round trips.
+  stats_round_trip();
+  if (auto *tree = xcb_query_tree_reply(
+          conn.get(), xcb_query_tree(conn.get(), screen->root), nullptr)) {
+    xcb_window_t *children = xcb_query_tree_children(tree);
+    int count = xcb_query_tree_children_length(tree);
+    for (int i = 0; i < count; i++) {
+      if (!clients.lookup(children[i]))
+        pending_manage.push_back(
+            request_manage(conn.get(), atoms, children[i], true));
+    }
+    LOG_DEBUG("Scanning %d existing windows", count);
+    free(tree);
+  }
 
+  stats_flush(conn.get());
   xcb_flush(conn.get());
 
-  std::cout << "WM running ...\n" << std::endl;
+  LOG_INFO("WM running ...");
 
-  while (true) {
-    xcb_generic_event_t *event = xcb_wait_for_event(conn.get());
-    if (!event)
-      break;
+  // Titlebars that need repainting, drawn once at the end of each batch.
+  std::vector<ClientHandle> dirty_clients;
+
+  auto mark_dirty = [&](Client &c, uint8_t reason) {
+    if (!c.dirty)
+      dirty_clients.push_back(clients.handle_of(c.window));
+    c.dirty |= reason;
+  };
+
+  // Ends an Alt+Tab session, making the client it settled on the most
+  // recent one.
+  auto end_cycle = [&]() {
+    if (!cycle.active)
+      return;
+    cycle.active = false;
+    xcb_ungrab_keyboard(conn.get(), XCB_CURRENT_TIME);
+    if (Client *c = clients.get(cycle.current))
+      workspaces[c->workspace].focus.move_to_front(clients, cycle.current);
+  };
+
+  // Only the titlebars losing and gaining focus are redrawn. Focus moved
+  // anywhere but to the Alt+Tab candidate ends the session.
+  auto set_focus = [&](xcb_window_t window) {
+    if (window == focused_window)
+      return;
+    ClientHandle handle = clients.handle_of(window);
+    if (cycle.active && handle != cycle.current)
+      end_cycle();
+    if (Client *old = clients.find(focused_window))
+      mark_dirty(*old, DIRTY_FOCUS);
+    focused_window = window;
+    if (Client *c = clients.find(focused_window)) {
+      mark_dirty(*c, DIRTY_FOCUS);
+      if (!cycle.active)
+        workspaces[c->workspace].focus.move_to_front(clients, handle);
+    }
+    ewmh.mark(EWMH_ACTIVE);
+  };
+
+  // Focuses c and raises it to the top of the stack.
+  auto focus_client = [&](Client &c) {
+    set_focus(c.window);
+    xcb_set_input_focus(conn.get(), XCB_INPUT_FOCUS_POINTER_ROOT, c.window,
+                        XCB_CURRENT_TIME);
+
+    uint32_t raise[] = {XCB_STACK_MODE_ABOVE};
+    xcb_configure_window(conn.get(), c.frame, XCB_CONFIG_WINDOW_STACK_MODE,
+                         raise);
+    stacking.move_to_back(clients, clients.handle_of(c.window));
+    ewmh.mark(EWMH_STACKING);
+  };
+
+  // Asks c to close with WM_DELETE_WINDOW, and kills it if it is still
+  // there after CLOSE_TIMEOUT; the loop keeps running in the meantime, and
+  // the exit is noticed as a DestroyNotify. Clients without the protocol,
+  // and ones closed again while a close is pending, are killed right away.
+  auto close_client = [&](Client &c, xcb_timestamp_t time) {
+    if (!c.supports_delete || c.close_timer) {
+      loop.cancel_timer(c.close_timer);
+      c.close_timer = 0;
+      xcb_kill_client(conn.get(), c.window);
+      return;
+    }
+
+    send_delete_window(conn.get(), atoms, c.window, time);
+    xcb_window_t window = c.window;
+    c.close_timer = loop.add_timer(CLOSE_TIMEOUT, [&, window]() {
+      Client *client = clients.find(window);
+      if (!client)
+        return;
+      client->close_timer = 0;
+      LOG_INFO("Killing unresponsive client: %u", window);
+      xcb_kill_client(conn.get(), window);
+    });
+  };
+
+  // Forgets c and tears down its frame. A client that withdrew its window,
+  // rather than destroying it, gets it back as a top-level window.
+  auto unmanage = [&](Client &c, bool withdrawn) {
+    xcb_window_t window = c.window;
+    LOG_DEBUG("Unmanaging frame: %u", c.frame);
+
+    if (drag.frame == c.frame) {
+      drag.active = false;
+      drag.frame = XCB_NONE;
+    }
+    if (resize.frame == c.frame) {
+      loop.cancel_timer(resize.timer);
+      resize = ResizeState();
+    }
+    loop.cancel_timer(c.close_timer);
+
+    if (withdrawn) {
+      uint32_t no_events = 0;
+      xcb_change_window_attributes(conn.get(), window, XCB_CW_EVENT_MASK,
+                                   &no_events);
+      xcb_ungrab_button(conn.get(), XCB_BUTTON_INDEX_1, window,
+                        XCB_MOD_MASK_ANY);
+      xcb_delete_property(conn.get(), window, atoms.net_wm_state);
+      xcb_delete_property(conn.get(), window, atoms.net_wm_desktop);
+      xcb_reparent_window(conn.get(), window, screen->root,
+                          c.x + FRAME_BORDER,
+                          c.y + FRAME_BORDER + TITLE_HEIGHT);
+    }
+    destroy_frame(c);
+
+    ClientHandle handle = clients.handle_of(window);
+    stacking.remove(clients, handle);
+    client_order.remove(clients, handle);
+    workspaces[c.workspace].focus.remove(clients, handle);
+    clients.erase(handle);
+    if (focused_window == window) {
+      set_focus(XCB_NONE);
+    }
+    ewmh.mark(EWMH_CLIENT_LIST | EWMH_STACKING);
+  };
+
+  // Errors of the requests sent unchecked, which is all of them. A
+  // BadWindow naming a managed client window, or any error of a request
+  // registered for one, means the window is gone without its
+  // DestroyNotify having been handled; the frame would stay behind
+  // otherwise. Other errors come from requests racing a window's
+  // destruction (the cleanup of a withdrawn window that was destroyed
+  // right after) and need nothing.
+  auto handle_error = [&](const xcb_generic_error_t *e) {
+    PendingRequest request;
+    xcb_window_t window = XCB_NONE;
+    if (errors.match(e, request))
+      window = request.window;
+    else if (e->error_code == XCB_WINDOW)
+      window = e->resource_id;
+
+    if (Client *c = clients.find(window)) {
+      LOG_INFO("Client window %u is gone (error %u, request %u)", window,
+               e->error_code, e->major_code);
+      unmanage(*c, false);
+      return;
+    }
+    LOG_DEBUG("X error %u, request %u.%u, resource %u", e->error_code,
+              e->major_code, e->minor_code, e->resource_id);
+  };
+
+  // Shows workspace index instead of the current one. Every frame is
+  // mapped or unmapped inside one server grab, so the switch appears at
+  // once and costs no round trips; nothing about the clients is fetched
+  // again. The frames' UnmapNotify events are ignored by role.
+  auto switch_workspace = [&](int index) {
+    if (index == current_workspace || index < 0 || index >= NUM_WORKSPACES)
+      return;
+    uint64_t started = stats_enabled ? stats_now_ns() : 0;
+
+    if (drag.active || resize.active) {
+      drag = DragState();
+      loop.cancel_timer(resize.timer);
+      resize = ResizeState();
+    }
+
+    workspaces[current_workspace].focused_window = focused_window;
+    int previous = current_workspace;
+    current_workspace = index;
+    ewmh.mark(EWMH_DESKTOP);
+
+    xcb_grab_server(conn.get());
+    for (const Client &c : clients) {
+      if (c.workspace == index)
+        xcb_map_window(conn.get(), c.frame);
+      else if (c.workspace == previous)
+        xcb_unmap_window(conn.get(), c.frame);
+    }
+
+    if (Client *c = clients.find(workspaces[index].focused_window)) {
+      focus_client(*c);
+    } else {
+      set_focus(XCB_NONE);
+      xcb_set_input_focus(conn.get(), XCB_INPUT_FOCUS_POINTER_ROOT,
+                          XCB_INPUT_FOCUS_POINTER_ROOT, XCB_CURRENT_TIME);
+    }
+    xcb_ungrab_server(conn.get());
+
+    // Measured up to the server having done all of it, which takes an
+    // extra round trip; only paid for with --stats.
+    if (stats_enabled) {
+      stats_round_trip();
+      free(xcb_get_input_focus_reply(conn.get(),
+                                     xcb_get_input_focus(conn.get()), nullptr));
+      stats_workspace_switch(stats_now_ns() - started);
+    }
+  };
+
+  // Moves c to workspace index, hiding it if that is not the current one
+  // and showing it if it comes from a hidden one. Either way it becomes the
+  // most recent client of its new workspace, so Alt+Tab reaches it first.
+  auto send_to_workspace = [&](Client &c, int index) {
+    if (index == c.workspace || index < 0 || index >= NUM_WORKSPACES)
+      return;
+
+    Workspace &from = workspaces[c.workspace];
+    Workspace &to = workspaces[index];
+    bool tiled = from.tiling[c.monitor].contains(c.frame);
+    from.placement.remove(c.frame);
+    from.tiling[c.monitor].remove(c.frame);
+    if (tiled)
+      to.tiling[c.monitor].insert(c.frame, XCB_NONE);
+    to.placement.set(c.frame,
+                     placement_rect(c.x, c.y, c.width, frame_height(c)));
+    ClientHandle handle = clients.handle_of(c.window);
+    from.focus.remove(clients, handle);
+    to.focus.push_front(clients, handle);
+    c.workspace = index;
+    set_wm_desktop(conn.get(), atoms, c);
+
+    if (index != current_workspace) {
+      if (drag.frame == c.frame)
+        drag = DragState();
+      if (resize.frame == c.frame) {
+        loop.cancel_timer(resize.timer);
+        resize = ResizeState();
+      }
+      xcb_unmap_window(conn.get(), c.frame);
+      if (focused_window == c.window)
+        set_focus(XCB_NONE);
+    } else {
+      // Unmapped by switch_workspace; the frame kept its place in the
+      // stack, as frames shown by switching back do.
+      xcb_map_window(conn.get(), c.frame);
+    }
+  };
+
+  // Makes c cover its monitor, or puts it back where it was (or into its
+  // tile). The frame stays, pushed out so that its border and titlebar lie
+  // off the monitor.
+  auto set_fullscreen = [&](Client &c, bool fullscreen) {
+    if (fullscreen == c.fullscreen)
+      return;
+    if (drag.frame == c.frame)
+      drag = DragState();
+    if (resize.frame == c.frame) {
+      loop.cancel_timer(resize.timer);
+      resize = ResizeState();
+    }
+
+    if (fullscreen) {
+      c.saved_x = c.x;
+      c.saved_y = c.y;
+      c.saved_width = c.width;
+      c.saved_height = c.height;
+      const Rect &m = monitors[monitor_of(c)];
+      c.x = m.x - FRAME_BORDER;
+      c.y = m.y - FRAME_BORDER - TITLE_HEIGHT;
+      c.width = m.width;
+      c.height = m.height;
+    } else if (const Rect *tile =
+                   workspaces[c.workspace].tiling[c.monitor].tile_of(
+                       c.frame)) {
+      tile_geometry(*tile, c.x, c.y, c.width, c.height);
+    } else {
+      c.x = c.saved_x;
+      c.y = c.saved_y;
+      c.width = c.saved_width;
+      c.height = c.saved_height;
+    }
+    c.fullscreen = fullscreen;
+    configure_client(conn.get(), c);
+    mark_dirty(c, DIRTY_SIZE);
+    set_wm_state(conn.get(), atoms, c);
+
+    if (fullscreen) {
+      uint32_t raise[] = {XCB_STACK_MODE_ABOVE};
+      xcb_configure_window(conn.get(), c.frame, XCB_CONFIG_WINDOW_STACK_MODE,
+                           raise);
+    }
+  };
+
+  // Reconfigures the tiled frames whose tile changed since the last call.
+  auto apply_tiling = [&]() {
+    for (Workspace &ws : workspaces) {
+      for (BspLayout &tiling : ws.tiling) {
+        for (const BspLayout::Change &change : tiling.take_changes()) {
+          Client *c = clients.lookup(change.first);
+          if (!c || c->fullscreen)
+            continue;
+          int x, y, width, height;
+          tile_geometry(change.second, x, y, width, height);
+          if (x == c->x && y == c->y && width == c->width &&
+              height == c->height)
+            continue;
+          if (width != c->width)
+            mark_dirty(*c, DIRTY_SIZE);
+          c->x = x;
+          c->y = y;
+          c->width = width;
+          c->height = height;
+          configure_client(conn.get(), *c);
+        }
+      }
+    }
+  };
+
+  auto repaint_dirty = [&]() {
+    for (ClientHandle handle : dirty_clients) {
+      Client *c = clients.get(handle);
+      if (!c)
+        continue;
+      draw_titlebar(conn.get(), screen->root, screen->root_depth, *c,
+                    c->window == focused_window);
+      c->dirty = 0;
+    }
+    dirty_clients.clear();
+  };
+
+  // Collects the replies for every queued MapRequest and frames the
+  // windows. Every request was sent when its MapRequest arrived, so a burst
+  // of maps costs one round trip in total.
+  auto manage_pending = [&]() {
+    std::vector<PendingManage> batch;
+    batch.swap(pending_manage);
+
+    for (auto &p : batch) {
+      stats_round_trip();
+      auto *attr =
+          xcb_get_window_attributes_reply(conn.get(), p.attr, nullptr);
+      stats_round_trip();
+      auto *geom = xcb_get_geometry_reply(conn.get(), p.geom, nullptr);
+      int x = 0, y = 0;
+      bool user_pos = false;
+      bool has_position = position_hints(conn.get(), p.hints, x, y, user_pos);
+      std::string title = title_from_replies(conn.get(), p.title);
+      bool supports_delete;
+      uint32_t sync_counter = sync_counter_from_replies(
+          conn.get(), atoms, p.protocols, p.sync_counter, supports_delete);
+      bool fullscreen = fullscreen_from_reply(conn.get(), atoms, p.state);
+
+      bool manage = attr && p.window != XCB_NONE && !clients.lookup(p.window);
+      if (manage && attr->override_redirect) {
+        if (!p.adopt)
+          xcb_map_window(conn.get(), p.window);
+        manage = false;
+      }
+      if (manage && p.adopt) {
+        manage = attr->map_state == XCB_MAP_STATE_VIEWABLE;
+        if (geom) {
+          x = geom->x;
+          y = geom->y;
+          has_position = true;
+          user_pos = true;
+        }
+      }
+
+      int width = geom ? geom->width : 800;
+      int height = geom ? geom->height : 400;
+
+      free(attr);
+      free(geom);
+
+      if (!manage)
+        continue;
+
+      // New windows open on the focused window's monitor.
+      const Client *near = clients.find(focused_window);
+      int monitor = near ? monitor_of(*near) : 0;
+
+      // Only a position the user asked for is kept; programs that set one
+      // mostly pick 0,0 or their last position, regardless of what is there.
+      if (!has_position || !user_pos) {
+        Rect want = placement_rect(0, 0, width, height + TITLE_HEIGHT);
+        workspaces[current_workspace].placement.find(want.width, want.height,
+                                                     monitor, x, y);
+      }
+      xcb_window_t frame = xcb_generate_id(conn.get());
+
+      if (tile) {
+        if (near)
+          monitor = near->monitor;
+        BspLayout &tiling = workspaces[current_workspace].tiling[monitor];
+        tiling.insert(frame, near ? near->frame : XCB_NONE);
+        tile_geometry(*tiling.tile_of(frame), x, y, width, height);
+      }
+
+      xcb_window_t titlebar = xcb_generate_id(conn.get());
 
+      xcb_create_window(conn.get(), XCB_COPY_FROM_PARENT, frame, screen->root,
+                        x, y, width, height + TITLE_HEIGHT, FRAME_BORDER,
+                        XCB_WINDOW_CLASS_INPUT_OUTPUT,
+                        screen->root_visual, XCB_CW_EVENT_MASK, &frame_events);
+
+      xcb_create_window(conn.get(), XCB_COPY_FROM_PARENT, titlebar, frame, 0, 0,
+                        width, TITLE_HEIGHT, 0, XCB_WINDOW_CLASS_INPUT_OUTPUT,
+                        screen->root_visual, XCB_CW_EVENT_MASK,
+                        &titlebar_events);
+
+      errors.expect(
+          xcb_reparent_window(conn.get(), p.window, frame, 0, TITLE_HEIGHT),
+          Expect::Reparent, p.window);
+      // Gets the window back out of the frame should we die.
+      xcb_change_save_set(conn.get(), XCB_SET_MODE_INSERT, p.window);
+
+      grab_focus_click(conn.get(), p.window);
+
+      xcb_change_window_attributes(conn.get(), p.window, XCB_CW_EVENT_MASK,
+                                   &client_events);
+
+      xcb_gcontext_t titlebar_gc = xcb_generate_id(conn.get());
+      uint32_t titlebar_gc_vals[] = {COLOR_INACTIVE, 0};
+      xcb_create_gc(conn.get(), titlebar_gc, titlebar,
+                    XCB_GC_FOREGROUND | XCB_GC_GRAPHICS_EXPOSURES,
+                    titlebar_gc_vals);
+
+      xcb_map_window(conn.get(), titlebar);
+      xcb_map_window(conn.get(), frame);
+      xcb_map_window(conn.get(), p.window);
+
+      Client client{frame, titlebar, p.window, titlebar_gc, x, y, width,
+                    height, title.empty() ? "Untitled" : title};
+      client.sync_counter = sync_counter;
+      client.supports_delete = supports_delete;
+      client.workspace = current_workspace;
+      client.monitor = monitor;
+      // Reparenting a viewable window unmaps it once.
+      if (p.adopt)
+        client.ignore_unmaps = 1;
+      ClientHandle handle = clients.insert(client);
+      // New windows count as the most recent, so Alt+Tab reaches them first.
+      workspaces[current_workspace].focus.push_front(clients, handle);
+      workspaces[current_workspace].placement.set(
+          frame, placement_rect(x, y, width, height + TITLE_HEIGHT));
+      client_order.push_back(clients, handle);
+      stacking.push_back(clients, handle);
+      ewmh.mark(EWMH_CLIENT_LIST | EWMH_STACKING);
+
+      Client &managed = *clients.find(p.window);
+      set_wm_desktop(conn.get(), atoms, managed);
+      if (fullscreen)
+        set_fullscreen(managed, true);
+    }
+  };
+
+  // Sends the pending interactive resize if the client is ready for it.
+  // Sync clients get one outstanding _NET_WM_SYNC_REQUEST at a time, the
+  // rest are capped at RESIZE_INTERVAL. force skips pacing, for the final
+  // geometry on button release.
+  std::function<void(bool)> flush_resize = [&](bool force) {
+    Client *c = clients.lookup(resize.frame);
+    if (!resize.pending || !c)
+      return;
+
+    bool use_sync = sync.present && c->sync_counter != XCB_NONE;
+    auto now = std::chrono::steady_clock::now();
+    if (!force) {
+      std::chrono::steady_clock::time_point ready;
+      if (use_sync)
+        ready = resize.sync_pending ? resize.sync_sent + SYNC_TIMEOUT : now;
+      else
+        ready = resize.last_sent + RESIZE_INTERVAL;
+
+      if (now < ready) {
+        if (!resize.timer) {
+          resize.timer = loop.add_timer(ready - now, [&]() {
+            resize.timer = 0;
+            flush_resize(false);
+          });
+        }
+        return;
+      }
+    }
+
+    if (use_sync) {
+      send_sync_request(conn.get(), atoms, *c, resize.time);
+      resize.sync_pending = true;
+      resize.sync_sent = now;
+    }
+
+    c->x = resize.x;
+    c->y = resize.y;
+    c->width = resize.w;
+    c->height = resize.h;
+    configure_client(conn.get(), *c);
+    mark_dirty(*c, DIRTY_SIZE);
+
+    resize.pending = false;
+    resize.last_sent = now;
+  };
+
+  int events_while_pending = 0;
+  xcb_generic_event_t *deferred_event = nullptr;
+
+  auto handle_event = [&](xcb_generic_event_t *event) {
     uint8_t type = event->response_type & ~0x80;
 
     switch (type) {
+    case 0:
+      handle_error(reinterpret_cast<xcb_generic_error_t *>(event));
+      break;
+
     case XCB_CONFIGURE_REQUEST: {
       auto *e = reinterpret_cast<xcb_configure_request_event_t *>(event);
 
-      std::cout << "Configure request received for window: " << e->window
-                << "\n"
-                << std::endl;
+      LOG_DEBUG("Configure request received for window: %u", e->window);
 
-      auto it = clients.find(e->window);
-      if (it == clients.end()) {
+      Client *managed = clients.find(e->window);
+      if (!managed) {
         uint32_t values[7];
         int i = 0;
 
@@ -286,7 +1378,14 @@ int main() {
         break;
       }
 
-      Client &c = it->second;
+      Client &c = *managed;
+
+      // Tiled and fullscreen windows keep their geometry; answer with it.
+      if (c.fullscreen ||
+          workspaces[c.workspace].tiling[c.monitor].contains(c.frame)) {
+        configure_client(conn.get(), c);
+        break;
+      }
 
       if (e->value_mask & XCB_CONFIG_WINDOW_X)
         c.x = e->x;
@@ -297,283 +1396,198 @@ int main() {
       if (e->value_mask & XCB_CONFIG_WINDOW_HEIGHT)
         c.height = e->height;
 
-      uint32_t frame_vals[] = {
-          static_cast<uint32_t>(c.x), static_cast<uint32_t>(c.y),
-          static_cast<uint32_t>(c.width), static_cast<uint32_t>(c.height)};
-
-      xcb_configure_window(conn.get(), c.frame,
-                           XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y |
-                               XCB_CONFIG_WINDOW_WIDTH |
-                               XCB_CONFIG_WINDOW_HEIGHT,
-                           frame_vals);
-      xcb_configure_window(conn.get(), c.window,
-                           XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y,
-                           &frame_vals[2]);
+      if (c.width < MIN_WIDTH)
+        c.width = MIN_WIDTH;
+      if (c.height < MIN_HEIGHT)
+        c.height = MIN_HEIGHT;
 
+      configure_client(conn.get(), c);
+      mark_dirty(c, DIRTY_SIZE);
       break;
     }
-    case XCB_MAP_REQUEST: {
-      std::cout << "Map request received\n" << std::endl;
-      auto *e = reinterpret_cast<xcb_map_request_event_t *>(event);
-
-      xcb_get_window_attributes_cookie_t attr_cookie =
-          xcb_get_window_attributes(conn.get(), e->window);
-      xcb_get_window_attributes_reply_t *attr =
-          xcb_get_window_attributes_reply(conn.get(), attr_cookie, nullptr);
+    case XCB_CONFIGURE_NOTIFY: {
+      auto *e = reinterpret_cast<xcb_configure_notify_event_t *>(event);
 
-      if (!attr)
+      WindowRole role;
+      Client *client = clients.lookup(e->window, &role);
+      if (!client || role != WindowRole::Frame)
         break;
 
-      if (attr->override_redirect) {
-        free(attr);
-        xcb_map_window(conn.get(), e->window);
-        break;
+      restack(clients, stacking, *client, e->above_sibling);
+      ewmh.mark(EWMH_STACKING);
+      workspaces[client->workspace].placement.set(
+          client->frame, placement_rect(e->x, e->y, e->width, e->height));
+
+      // Notifies for our own in-flight configures lag behind the model
+      // during an interactive move, so only reconcile when idle.
+      if (drag.frame != client->frame && resize.frame != client->frame) {
+        if (client->width != e->width)
+          mark_dirty(*client, DIRTY_SIZE);
+        client->x = e->x;
+        client->y = e->y;
+        client->width = e->width;
+        client->height = e->height - TITLE_HEIGHT;
       }
+      break;
+    }
+    case XCB_MAP_REQUEST: {
+      auto *e = reinterpret_cast<xcb_map_request_event_t *>(event);
+      LOG_DEBUG("Map request received for window: %u", e->window);
 
-      free(attr);
-
-      if (clients.find(e->window) != clients.end()) {
+      if (clients.lookup(e->window)) {
         break;
       }
 
-      auto geom_cookie = xcb_get_geometry(conn.get(), e->window);
-      auto *geom = xcb_get_geometry_reply(conn.get(), geom_cookie, nullptr);
-
-      int x = 0, y = 0;
-      bool user_pos = false;
-      int width = geom ? geom->width : 800;
-      int height = geom ? geom->height : 400;
-
-      if (geom)
-        free(geom);
-
-      if (!position_hints(conn.get(), e->window, x, y, user_pos)) {
-
-        x = next_x;
-        y = next_y;
-
-        next_x += width + gap;
-        row_height = std::max(row_height, height + TITLE_HEIGHT);
-        if (next_x + width > screen->width_in_pixels) {
-          next_x = 50;
-          next_y += row_height + gap;
-          row_height = 0;
-        }
-        if (next_y + row_height + TITLE_HEIGHT > screen->height_in_pixels) {
-          next_y = 50;
-          next_x += width + gap;
-          row_height = 0;
-        }
-      }
-      xcb_window_t frame = xcb_generate_id(conn.get());
-
-      xcb_window_t titlebar = xcb_generate_id(conn.get());
-
-      uint32_t frame_events[] = {
-          XCB_EVENT_MASK_EXPOSURE | XCB_EVENT_MASK_BUTTON_PRESS |
-          XCB_EVENT_MASK_BUTTON_RELEASE | XCB_EVENT_MASK_POINTER_MOTION |
-          XCB_EVENT_MASK_PROPERTY_CHANGE};
-
-      xcb_create_window(conn.get(), XCB_COPY_FROM_PARENT, frame, screen->root,
-                        x, y, width, height, 10, XCB_WINDOW_CLASS_INPUT_OUTPUT,
-                        screen->root_visual, XCB_CW_EVENT_MASK, frame_events);
-
-      uint32_t titlebar_events[] = {
-          XCB_EVENT_MASK_BUTTON_PRESS | XCB_EVENT_MASK_EXPOSURE |
-          XCB_EVENT_MASK_BUTTON_RELEASE | XCB_EVENT_MASK_POINTER_MOTION};
-
-      xcb_create_window(conn.get(), XCB_COPY_FROM_PARENT, titlebar, frame, 0, 0,
-                        width, TITLE_HEIGHT, 0, XCB_WINDOW_CLASS_INPUT_OUTPUT,
-                        screen->root_visual, XCB_CW_EVENT_MASK,
-                        titlebar_events);
-
-      xcb_reparent_window(conn.get(), e->window, frame, 0, TITLE_HEIGHT);
-
-      xcb_grab_button(conn.get(), 0, e->window,
-                      XCB_EVENT_MASK_BUTTON_PRESS |
-                          XCB_EVENT_MASK_BUTTON_RELEASE,
-                      XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC, XCB_NONE,
-                      XCB_NONE, XCB_BUTTON_INDEX_1, XCB_MOD_MASK_ANY);
-
-      uint32_t titlebar_client_events[] = {XCB_EVENT_MASK_PROPERTY_CHANGE};
-
-      xcb_change_window_attributes(conn.get(), e->window, XCB_CW_EVENT_MASK,
-                                   titlebar_client_events);
-
-      xcb_gcontext_t titlebar_gc = xcb_generate_id(conn.get());
-      uint32_t titlebar_gc_vals[] = {COLOR_INACTIVE};
-      xcb_create_gc(conn.get(), titlebar_gc, titlebar, XCB_GC_FOREGROUND,
-                    titlebar_gc_vals);
-
-      xcb_map_window(conn.get(), titlebar);
-      xcb_map_window(conn.get(), frame);
-      xcb_map_window(conn.get(), e->window);
-
-      std::string title = get_window_title(conn.get(), e->window);
-      if (title.empty())
-        title = "Untitled";
-      clients[e->window] = {frame, titlebar, e->window, titlebar_gc, x,
-                            y,     width,    height,    title};
-      client_order.push_back(e->window);
+      bool queued = std::any_of(
+          pending_manage.begin(), pending_manage.end(),
+          [&](const PendingManage &p) { return p.window == e->window; });
+      if (!queued)
+        pending_manage.push_back(
+            request_manage(conn.get(), atoms, e->window));
       break;
     }
 
     case XCB_BUTTON_PRESS: {
       auto *e = reinterpret_cast<xcb_button_press_event_t *>(event);
 
-      std::cout << "Button press event received for window: " << e->event
-                << "\n"
-                << std::endl;
-
-      for (auto &[window, client] : clients) {
-
-        if ((e->event == client.frame) || (e->event == client.window) ||
-            (e->child == client.window) || (e->event == client.titlebar)) {
-
-          if (e->detail == 1) {
-            auto geom_cookie = xcb_get_geometry(conn.get(), client.frame);
-
-            auto *geom =
-                xcb_get_geometry_reply(conn.get(), geom_cookie, nullptr);
-
-            if (!geom)
-              break;
-
-            int rx = e->root_x - geom->x;
-            int ry = e->root_y - geom->y;
-
-            resize.edges = RESIZE_NONE;
-            if (rx < RESIZE_BORDER)
-              resize.edges |= RESIZE_LEFT;
-            if (rx > geom->width - RESIZE_BORDER)
-              resize.edges |= RESIZE_RIGHT;
-            if (ry < RESIZE_BORDER)
-              resize.edges |= RESIZE_TOP;
-            if (ry > geom->height - RESIZE_BORDER)
-              resize.edges |= RESIZE_BOTTOM;
-
-            if (resize.edges != RESIZE_NONE) {
-              resize.active = true;
-              resize.frame = client.frame;
-              resize.start_root_x = e->root_x;
-              resize.start_root_y = e->root_y;
-              resize.start_x = geom->x;
-              resize.start_y = geom->y;
-              resize.start_w = geom->width;
-              resize.start_h = geom->height;
-            } else if (e->event == client.titlebar) {
-              drag.active = true;
-              drag.frame = client.frame;
-              drag.start_root_x = e->root_x;
-              drag.start_root_y = e->root_y;
-              drag.start_x = geom->x;
-              drag.start_y = geom->y;
-            }
-
-            free(geom);
-          }
-          focused_window = client.window;
+      LOG_DEBUG("Button press event received for window: %u", e->event);
 
-          if (resize.active) {
-            set_cursor(conn.get(),client.frame,cursor_for_edges(cursors,resize.edges));
-          } else if(drag.active) {
-            set_cursor(conn.get(),client.frame,cursors.move);
-          }
-
-          xcb_set_input_focus(conn.get(), XCB_INPUT_FOCUS_POINTER_ROOT,
-                              client.window, XCB_CURRENT_TIME);
-
-          uint32_t values[] = {XCB_STACK_MODE_ABOVE};
-          xcb_configure_window(conn.get(), client.frame,
-                               XCB_CONFIG_WINDOW_STACK_MODE, values);
+      WindowRole role;
+      Client *client = clients.lookup(e->event, &role);
+      if (!client) {
+        client = clients.find(e->child);
+        role = WindowRole::Client;
+      }
 
-          break;
+      if (client) {
+        if (e->detail == 1 && !client->fullscreen &&
+            !workspaces[client->workspace].tiling[client->monitor].contains(
+                client->frame)) {
+          resize.edges = edges_at(*client, e->root_x, e->root_y);
+
+          if (resize.edges != RESIZE_NONE) {
+            resize.active = true;
+            resize.frame = client->frame;
+            resize.start_root_x = e->root_x;
+            resize.start_root_y = e->root_y;
+            resize.start_x = client->x;
+            resize.start_y = client->y;
+            resize.start_w = client->width;
+            resize.start_h = client->height;
+          } else if (role == WindowRole::Titlebar) {
+            drag.active = true;
+            drag.frame = client->frame;
+            drag.start_root_x = e->root_x;
+            drag.start_root_y = e->root_y;
+            drag.start_x = client->x;
+            drag.start_y = client->y;
+          }
         }
-      }
-      for (auto &[window, client] : clients) {
-        draw_titlebar(
-            conn.get(), client.titlebar, client.titlebar_gc,
-            (client.window == focused_window ? COLOR_ACTIVE : COLOR_INACTIVE),
-            client.title, client.width);
+        if (resize.active) {
+          set_cursor(conn.get(), *client,
+                     cursor_for_edges(cursors, resize.edges));
+        } else if (drag.active) {
+          set_cursor(conn.get(), *client, cursors.move);
+        }
+
+        focus_client(*client);
       }
       break;
     }
 
     case XCB_DESTROY_NOTIFY: {
       auto *e = reinterpret_cast<xcb_destroy_notify_event_t *>(event);
-      std::cout << "Destroy notify received for window: " << e->window << "\n"
-                << std::endl;
+      LOG_DEBUG("Destroy notify received for window: %u", e->window);
 
-      auto it = clients.find(e->window);
+      for (auto &p : pending_manage) {
+        if (p.window == e->window)
+          p.window = XCB_NONE;
+      }
 
-      if (it != clients.end()) {
-        std::cout << "Destroy notify it: " << it->second.frame << "\n"
-                  << std::endl;
+      if (Client *c = clients.find(e->window))
+        unmanage(*c, false);
+      break;
+    }
 
-        if (drag.frame == it->second.frame) {
-          drag.active = false;
-          drag.frame = XCB_NONE;
-        }
+    case XCB_UNMAP_NOTIFY: {
+      auto *e = reinterpret_cast<xcb_unmap_notify_event_t *>(event);
 
-        if (resize.frame == it->second.frame) {
-          resize.active = false;
-          resize.frame = XCB_NONE;
-        }
-        xcb_destroy_window(conn.get(), it->second.frame);
-        xcb_free_gc(conn.get(), it->second.titlebar_gc);
-        clients.erase(it);
-        if (focused_window == e->window) {
-          focused_window = XCB_NONE;
-        }
-        auto it_order =
-            std::find(client_order.begin(), client_order.end(), e->window);
-        if (it_order != client_order.end()) {
-          client_order.erase(it_order);
-        }
+      // Frames unmapped by a workspace switch are not client windows, and
+      // a withdrawing client's synthetic notice follows the real one.
+      Client *c = clients.find(e->window);
+      if (!c || (e->response_type & 0x80))
+        break;
+
+      if (c->ignore_unmaps) {
+        c->ignore_unmaps--;
+        break;
       }
+
+      // A window destroyed while mapped is unmapped first. If its
+      // DestroyNotify is already queued, the window is not handed back:
+      // every request doing that would fail.
+      deferred_event = xcb_poll_for_queued_event(conn.get());
+      auto *next =
+          reinterpret_cast<xcb_destroy_notify_event_t *>(deferred_event);
+      bool destroyed =
+          next && (next->response_type & ~0x80) == XCB_DESTROY_NOTIFY &&
+          next->window == e->window;
+      LOG_DEBUG("Client %s window: %u", destroyed ? "destroyed" : "withdrew",
+                e->window);
+      unmanage(*c, !destroyed);
       break;
     }
 
     case XCB_MOTION_NOTIFY: {
       auto *e = reinterpret_cast<xcb_motion_notify_event_t *>(event);
 
-      std::cout << "Motion notify received for window: " << e->event << "\n"
-                << std::endl;
+      // Only the newest pointer position matters while dragging or
+      // resizing: fold every motion already queued into this one and hold
+      // back the first event of another kind for the next iteration. The
+      // folded motions are still received events, so they are traced and
+      // counted here, as handled at no cost.
+      if (resize.active || drag.active) {
+        while (xcb_generic_event_t *next =
+                   xcb_poll_for_queued_event(conn.get())) {
+          if ((next->response_type & ~0x80) != XCB_MOTION_NOTIFY) {
+            deferred_event = next;
+            break;
+          }
+          if (trace.is_open())
+            trace.record(next);
+          if (stats_enabled)
+            stats_event(next, 0);
+          *e = *reinterpret_cast<xcb_motion_notify_event_t *>(next);
+          free(next);
+        }
+      }
+
+      // A hinted motion only says the pointer moved; querying the pointer
+      // fetches the position and re-arms the hint.
+      if (e->detail == XCB_MOTION_HINT) {
+        stats_round_trip();
+        auto *pointer = xcb_query_pointer_reply(
+            conn.get(), xcb_query_pointer(conn.get(), e->event), nullptr);
+        if (!pointer)
+          break;
+        e->root_x = pointer->root_x;
+        e->root_y = pointer->root_y;
+        free(pointer);
+      }
 
       if (!resize.active && !drag.active) {
-        std::cout << "No active resize or drag\n" << std::endl;
-        for (auto &[window, client] : clients) {
-          if (client.frame == e->event || client.titlebar == e->event) {
-            auto geom_cookie = xcb_get_geometry(conn.get(), client.frame);
-            auto *geom =
-                xcb_get_geometry_reply(conn.get(), geom_cookie, nullptr);
-            if (!geom)
-              break;
-
-            int rx = e->root_x - geom->x;
-            int ry = e->root_y - geom->y;
-
-            int edges = RESIZE_NONE;
-            if (rx < RESIZE_BORDER)
-              edges |= RESIZE_LEFT;
-            if (rx > geom->width - RESIZE_BORDER)
-              edges |= RESIZE_RIGHT;
-            if (ry < RESIZE_BORDER)
-              edges |= RESIZE_TOP;
-            if (ry > geom->height - RESIZE_BORDER)
-              edges |= RESIZE_BOTTOM;
-
-            if (edges != RESIZE_NONE) {
-              set_cursor(conn.get(), client.frame,
-                         cursor_for_edges(cursors, edges));
-            } else if (e->event == client.titlebar) {
-              set_cursor(conn.get(), client.frame, cursors.move);
-            } else {
-              set_cursor(conn.get(), client.frame, cursors.normal);
-            }
-
-            free(geom);
-            break;
+        WindowRole role;
+        Client *client = clients.lookup(e->event, &role);
+        if (client && role != WindowRole::Client) {
+          int edges = edges_at(*client, e->root_x, e->root_y);
+
+          if (edges != RESIZE_NONE) {
+            set_cursor(conn.get(), *client,
+                       cursor_for_edges(cursors, edges));
+          } else if (role == WindowRole::Titlebar) {
+            set_cursor(conn.get(), *client, cursors.move);
+          } else {
+            set_cursor(conn.get(), *client, cursors.normal);
           }
         }
       }
@@ -600,40 +1614,36 @@ int main() {
           if (resize.edges & RESIZE_BOTTOM)
             h += dy;
 
+          // Moving edges stop at the monitor the frame is on.
+          const Rect &m = monitors[monitor_index.at(
+              resize.start_x + resize.start_w / 2,
+              resize.start_y + (resize.start_h + TITLE_HEIGHT) / 2)];
+          if ((resize.edges & RESIZE_LEFT) && x < m.x) {
+            w -= m.x - x;
+            x = m.x;
+          }
+          if ((resize.edges & RESIZE_TOP) && y < m.y) {
+            h -= m.y - y;
+            y = m.y;
+          }
+          if (resize.edges & RESIZE_RIGHT)
+            w = std::min(w, m.x + m.width - x - 2 * FRAME_BORDER);
+          if (resize.edges & RESIZE_BOTTOM)
+            h = std::min(h, m.y + m.height - y - 2 * FRAME_BORDER -
+                                TITLE_HEIGHT);
+
           if (w < MIN_WIDTH)
             w = MIN_WIDTH;
           if (h < MIN_HEIGHT)
             h = MIN_HEIGHT;
 
-          uint32_t vals[] = {static_cast<uint32_t>(x), static_cast<uint32_t>(y),
-                             static_cast<uint32_t>(w),
-                             static_cast<uint32_t>(h) + TITLE_HEIGHT};
-          xcb_configure_window(conn.get(), resize.frame,
-                               XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y |
-                                   XCB_CONFIG_WINDOW_WIDTH |
-                                   XCB_CONFIG_WINDOW_HEIGHT,
-                               vals);
-
-          uint32_t client_vals[] = {static_cast<uint32_t>(w),
-                                    static_cast<uint32_t>(h)};
-
-          for (auto &[window, client] : clients) {
-            if (client.frame == resize.frame) {
-              xcb_configure_window(conn.get(), client.window,
-                                   XCB_CONFIG_WINDOW_WIDTH |
-                                       XCB_CONFIG_WINDOW_HEIGHT,
-                                   client_vals);
-
-              client.x = x;
-              client.y = y;
-              client.width = w;
-              client.height = h;
-
-              xcb_configure_window(
-                  conn.get(), client.titlebar,
-                  XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT, &w);
-            }
-          }
+          resize.pending = true;
+          resize.x = x;
+          resize.y = y;
+          resize.w = w;
+          resize.h = h;
+          resize.time = e->time;
+          flush_resize(false);
         }
 
         if (drag.active) {
@@ -643,28 +1653,43 @@ int main() {
           int new_x = drag.start_x + dx;
           int new_y = drag.start_y + dy;
 
+          // Keep the titlebar reachable on the monitor under the pointer.
+          const Rect &m = monitors[monitor_index.at(e->root_x, e->root_y)];
+          if (const Client *c = clients.lookup(drag.frame)) {
+            int outer = c->width + 2 * FRAME_BORDER;
+            new_x = std::max(new_x, m.x + DRAG_MIN_VISIBLE - outer);
+            new_x = std::min(new_x, m.x + m.width - DRAG_MIN_VISIBLE);
+          }
+          new_y = std::max(new_y, m.y);
+          new_y = std::min(new_y, m.y + m.height - TITLE_HEIGHT);
+
           uint32_t values[] = {static_cast<uint32_t>(new_x),
                                static_cast<uint32_t>(new_y)};
 
           xcb_configure_window(conn.get(), drag.frame,
                                XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y,
                                values);
+
+          if (Client *client = clients.lookup(drag.frame)) {
+            client->x = new_x;
+            client->y = new_y;
+          }
         }
 
         break;
       }
 
     case XCB_BUTTON_RELEASE: {
-      std::cout << "Button release event received for window: __ " << "\n"
-                << std::endl;
+      LOG_DEBUG("Button release event received");
+
+      flush_resize(true);
 
       drag.active = false;
       drag.frame = XCB_NONE;
-      resize.active = false;
-      resize.frame = XCB_NONE;
-      if(focused_window != XCB_NONE){
-        auto& c = clients[focused_window];
-        set_cursor(conn.get(),c.frame,cursors.normal);
+      loop.cancel_timer(resize.timer);
+      resize = ResizeState();
+      if (Client *c = clients.find(focused_window)) {
+        set_cursor(conn.get(), *c, cursors.normal);
       }
       break;
     }
@@ -672,67 +1697,38 @@ int main() {
     case XCB_EXPOSE: {
       auto *e = reinterpret_cast<xcb_expose_event_t *>(event);
 
-      std::cout << "Expose event received for window: " << e->window << "\n"
-                << std::endl;
+      LOG_DEBUG("Expose event received for window: %u", e->window);
 
       if (e->count != 0)
         break;
 
-      for (auto &[window, client] : clients) {
-        if (e->window == client.titlebar) {
-          uint32_t color =
-              (focused_window == client.window ? COLOR_ACTIVE : COLOR_INACTIVE);
-          draw_titlebar(conn.get(), client.titlebar, client.titlebar_gc, color,
-                        client.title, client.width);
-          break;
-        }
+      WindowRole role;
+      Client *client = clients.lookup(e->window, &role);
+      if (client && role == WindowRole::Titlebar) {
+        mark_dirty(*client, DIRTY_EXPOSED);
       }
       break;
     }
     case XCB_PROPERTY_NOTIFY: {
       auto *e = reinterpret_cast<xcb_property_notify_event_t *>(event);
 
-      std::cout << "Property notify event triggered: " << e->window << "\n"
-                << std::endl;
+      LOG_DEBUG("Property notify event triggered: %u", e->window);
 
-      auto it = clients.find(e->window);
+      Client *managed = clients.find(e->window);
 
-      if (it == clients.end())
+      if (!managed)
         break;
 
-      xcb_intern_atom_cookie_t name_cookie =
-          xcb_intern_atom(conn.get(), 1, 12, "_NET_WM_NAME");
-      xcb_intern_atom_reply_t *name_reply =
-          xcb_intern_atom_reply(conn.get(), name_cookie, nullptr);
-
-      bool is_title_change = false;
-      if (name_reply) {
-        is_title_change = (e->atom == name_reply->atom);
-        free(name_reply);
-      }
-
-      if (!is_title_change) {
-        name_cookie = xcb_intern_atom(conn.get(), 1, 7, "WM_NAME");
-        name_reply = xcb_intern_atom_reply(conn.get(), name_cookie, nullptr);
-        if (name_reply) {
-          is_title_change = (e->atom == name_reply->atom);
-          free(name_reply);
-        }
-      }
-
-      if (is_title_change) {
-        Client &client = it->second;
-        client.title = get_window_title(conn.get(), client.window);
+      if (e->atom == atoms.net_wm_name || e->atom == XCB_ATOM_WM_NAME) {
+        Client &client = *managed;
+        client.title = get_window_title(conn.get(), atoms, client.window);
 
         if (client.title.empty())
           client.title = "Untitled";
 
-        std::cout << "Title changed: " << client.title << "\n" << std::endl;
+        LOG_DEBUG("Title changed: %s", client.title.c_str());
 
-        uint32_t color =
-            (focused_window == client.window ? COLOR_ACTIVE : COLOR_INACTIVE);
-        draw_titlebar(conn.get(), client.titlebar, client.titlebar_gc, color,
-                      client.title, client.width);
+        mark_dirty(client, DIRTY_TITLE);
       }
 
       break;
@@ -740,71 +1736,456 @@ int main() {
     case XCB_KEY_PRESS: {
       auto *e = reinterpret_cast<xcb_key_press_event_t *>(event);
 
-      std::cout << "Key press event received for window: " << e->event << "\n"
-                << std::endl;
-
       xcb_keysym_t sym = xcb_key_symbols_get_keysym(keysyms, e->detail, 0);
 
-      std::cout << "Key press: keycode=" << (int)e->detail
-                << " state=" << e->state << " keysym=" << sym << "\n"
-                << std::endl;
+      LOG_DEBUG("Key press: window=%u keycode=%d state=%u keysym=%u", e->event,
+                e->detail, e->state, sym);
 
       uint16_t clean_state =
           e->state & ~(XCB_MOD_MASK_LOCK | XCB_MOD_MASK_2 | XCB_MOD_MASK_3);
 
       if ((clean_state & XCB_MOD_MASK_1) && sym == XK_F4) {
-        std::cout << "inside  alt + f4 key press \n" << std::endl;
         if (focused_window != XCB_NONE) {
-          std::cout << "focused window: " << focused_window << "\n"
-                    << std::endl;
-          Client c = clients[focused_window];
-
-          xcb_destroy_window(conn.get(), c.frame);
+          LOG_DEBUG("Alt+F4 on focused window: %u", focused_window);
+          if (Client *c = clients.find(focused_window))
+            close_client(*c, e->time);
         }
       }
       if ((clean_state & XCB_MOD_MASK_1) && sym == XK_Tab) {
-        std::cout << "inside alt + tab  key press \n" << std::endl;
-        if (!client_order.empty()) {
-          auto it = std::find(client_order.begin(), client_order.end(),
-                              focused_window);
-
-          if (it == client_order.end() || ++it == client_order.end()) {
-            it = client_order.begin();
-          }
-          focused_window = *it;
-          Client &c = clients[focused_window];
-
-          xcb_set_input_focus(conn.get(), XCB_INPUT_FOCUS_POINTER_ROOT,
-                              c.window, XCB_CURRENT_TIME);
-
-          uint32_t raise[] = {XCB_STACK_MODE_ABOVE};
-          xcb_configure_window(conn.get(), c.frame,
-                               XCB_CONFIG_WINDOW_STACK_MODE, raise);
-
-          for (auto &[window, client] : clients) {
-            draw_titlebar(conn.get(), client.titlebar, client.titlebar_gc,
-                          (client.window == focused_window ? COLOR_ACTIVE
-                                                           : COLOR_INACTIVE),
-                          client.title, client.width);
+        // The first Tab goes to the most recent client other than the
+        // focused one, each further one down the list. The keyboard is
+        // grabbed so that the release of Alt, which ends the session, is
+        // reported to us; that costs one round trip per session. Alt may
+        // already be up by the time the grab takes effect, which the
+        // modifiers QueryPointer reports right after it tell, and another
+        // client may hold the keyboard. Either way the release would go
+        // unseen, so the focus change is committed at once instead.
+        ClientList &list = workspaces[current_workspace].focus;
+        ClientHandle next = list.front();
+        if (cycle.active) {
+          next = list.next(clients, cycle.current);
+        } else if (Client *front = clients.get(next)) {
+          if (front->window == focused_window)
+            next = list.next(clients, next);
+        }
+        if (Client *c = clients.get(next)) {
+          bool alt_held = true;
+          if (!cycle.active) {
+            stats_round_trip();
+            auto grab_cookie =
+                xcb_grab_keyboard(conn.get(), 0, screen->root, e->time,
+                                  XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC);
+            auto pointer_cookie = xcb_query_pointer(conn.get(), screen->root);
+            auto *grab =
+                xcb_grab_keyboard_reply(conn.get(), grab_cookie, nullptr);
+            auto *pointer =
+                xcb_query_pointer_reply(conn.get(), pointer_cookie, nullptr);
+            cycle.active = grab && grab->status == XCB_GRAB_STATUS_SUCCESS;
+            alt_held = pointer && (pointer->mask & XCB_MOD_MASK_1);
+            free(grab);
+            free(pointer);
           }
+          cycle.current = next;
+          focus_client(*c);
+          if (!alt_held)
+            end_cycle();
+        }
+      }
+      // Alt+N switches to workspace N, Alt+Shift+N sends the focused
+      // window there.
+      if ((clean_state & XCB_MOD_MASK_1) && sym >= XK_1 && sym <= XK_9) {
+        int index = static_cast<int>(sym - XK_1);
+        if (clean_state & XCB_MOD_MASK_SHIFT) {
+          if (Client *c = clients.find(focused_window))
+            send_to_workspace(*c, index);
+        } else {
+          switch_workspace(index);
         }
       }
 
       break;
     }
+    case XCB_KEY_RELEASE: {
+      // Only seen while the keyboard is grabbed for Alt+Tab.
+      auto *e = reinterpret_cast<xcb_key_release_event_t *>(event);
+      xcb_keysym_t sym = xcb_key_symbols_get_keysym(keysyms, e->detail, 0);
+      if (sym == XK_Alt_L || sym == XK_Alt_R || sym == XK_Meta_L ||
+          sym == XK_Meta_R || !(e->state & XCB_MOD_MASK_1))
+        end_cycle();
+      break;
+    }
     case XCB_CLIENT_MESSAGE: {
       auto *msg = reinterpret_cast<xcb_client_message_event_t *>(event);
-      std::cout << "Client message received for window: " << msg->window << "\n"
-                << std::endl;
+      LOG_DEBUG("Client message received for window: %u", msg->window);
+
+      if (msg->format != 32)
+        break;
+      const uint32_t *data = msg->data.data32;
+
+      if (msg->window == screen->root &&
+          msg->type == atoms.net_current_desktop) {
+        switch_workspace(static_cast<int>(data[0]));
+        break;
+      }
+
+      Client *c = clients.find(msg->window);
+      if (!c)
+        break;
+
+      if (msg->type == atoms.net_active_window) {
+        switch_workspace(c->workspace);
+        focus_client(*c);
+      } else if (msg->type == atoms.net_close_window) {
+        close_client(*c, data[0]);
+      } else if (msg->type == atoms.net_wm_desktop) {
+        send_to_workspace(*c, static_cast<int>(data[0]));
+      } else if (msg->type == atoms.net_wm_state &&
+                 (data[1] == atoms.net_wm_state_fullscreen ||
+                  data[2] == atoms.net_wm_state_fullscreen)) {
+        // data[0] is _NET_WM_STATE_REMOVE, _ADD or _TOGGLE.
+        bool fullscreen = data[0] == 2 ? !c->fullscreen : data[0] == 1;
+        set_fullscreen(*c, fullscreen);
+      }
       break;
     }
     default:
+      if (randr.present &&
+          type == randr.first_event + XCB_RANDR_SCREEN_CHANGE_NOTIFY) {
+        auto *e =
+            reinterpret_cast<xcb_randr_screen_change_notify_event_t *>(event);
+        bool rotated = e->rotation & (XCB_RANDR_ROTATION_ROTATE_90 |
+                                      XCB_RANDR_ROTATION_ROTATE_270);
+        root_width = rotated ? e->height : e->width;
+        root_height = rotated ? e->width : e->height;
+        monitors_changed = true;
+        break;
+      }
+      if (sync.present && type == sync.first_event + XCB_SYNC_ALARM_NOTIFY) {
+        auto *e = reinterpret_cast<xcb_sync_alarm_notify_event_t *>(event);
+
+        // The resizing client has drawn the last size; send the next one.
+        Client *c = clients.lookup(resize.frame);
+        if (resize.active && c && c->sync_alarm == e->alarm) {
+          resize.sync_pending = false;
+          flush_resize(false);
+        }
+      }
       break;
     }
-    xcb_flush(conn.get());
+  };
+
+  // An event held back by the previous one, one that arrived during
+  // startup, or the next one from the connection.
+  auto next_event = [&]() -> xcb_generic_event_t * {
+    if (deferred_event)
+      return std::exchange(deferred_event, nullptr);
+    if (!startup_events.empty()) {
+      xcb_generic_event_t *event = startup_events.front();
+      startup_events.erase(startup_events.begin());
+      return event;
+    }
+    return xcb_poll_for_event(conn.get());
+  };
+
+  // Handles everything available on the X connection, then ends the batch:
+  // frames queued windows, repaints dirty titlebars and flushes once. This
+  // runs after every loop wakeup, so requests sent by timer and signal
+  // callbacks are flushed here too.
+  auto process_x = [&]() {
+    while (true) {
+      while (xcb_generic_event_t *event = next_event()) {
+        errors.retire(event);
+        if (trace.is_open())
+          trace.record(event);
+        uint64_t started = stats_enabled ? stats_now_ns() : 0;
+        handle_event(event);
+        if (stats_enabled)
+          stats_event(event, stats_now_ns() - started);
+        free(event);
+
+        // A steady stream of events must not starve queued manages.
+        if (!pending_manage.empty() &&
+            ++events_while_pending >= MAX_EVENTS_BEFORE_MANAGE) {
+          manage_pending();
+          events_while_pending = 0;
+        }
+      }
+
+      if (xcb_connection_has_error(conn.get())) {
+        LOG_ERROR("Lost the connection to the X server");
+        loop.stop();
+        break;
+      }
+
+      if (!pending_manage.empty()) {
+        manage_pending();
+        events_while_pending = 0;
+      }
+      // Hotplug notifications come in bursts; the monitors are queried
+      // once, after all of them.
+      if (monitors_changed) {
+        monitors_changed = false;
+        set_monitors(query_monitors(conn.get(), screen->root, randr,
+                                    root_width, root_height));
+      }
+      apply_tiling();
+      ewmh.flush(conn.get(), clients, client_order, stacking, focused_window,
+                 current_workspace);
+      repaint_dirty();
+      stats_flush(conn.get());
+      xcb_flush(conn.get());
+      trace.flush();
+
+      // Replies collected above may have pulled more events off the socket,
+      // and those will not wake epoll again.
+      deferred_event = xcb_poll_for_queued_event(conn.get());
+      if (!deferred_event)
+        break;
+    }
+    log_drain();
+  };
 
-    free(event);
+  // Commands act on the same model as X events; the requests they send go
+  // out with the batch's single flush in process_x.
+  bool restart_requested = false;
+
+  auto run_command = [&](const std::vector<std::string> &args,
+                         std::string &out) -> std::string {
+    const std::string &cmd = args[0];
+
+    if (cmd == "list") {
+      client_order.for_each(clients, [&](const Client &c) {
+        out += describe_client(c, c.window == focused_window);
+      });
+      return "";
+    }
+
+    // Handles everything the X server has sent so far before answering, so
+    // a script that caused X events can wait until the WM has acted on them.
+    if (cmd == "sync") {
+      process_x();
+      return "";
+    }
+
+    if (cmd == "restart") {
+      restart_requested = true;
+      loop.stop();
+      return "";
+    }
+
+    if (cmd == "query" && args.size() == 1) {
+      char buf[80];
+      snprintf(buf, sizeof(buf), "focused 0x%x clients %zu workspace %d\n",
+               focused_window, clients.size(), current_workspace + 1);
+      out += buf;
+      return "";
+    }
+
+    std::vector<long> values;
+    for (size_t i = 1; i < args.size(); i++) {
+      long value;
+      if (!parse_long(args[i], &value))
+        return "bad argument: " + args[i];
+      values.push_back(value);
+    }
+
+    if (cmd == "workspace") {
+      if (values.size() != 1 || values[0] < 1 || values[0] > NUM_WORKSPACES)
+        return "usage: workspace 1-" + std::to_string(NUM_WORKSPACES);
+      switch_workspace(static_cast<int>(values[0]) - 1);
+      return "";
+    }
+
+    size_t expected;
+    const char *usage;
+    if (cmd == "query" || cmd == "focus" || cmd == "close") {
+      expected = 1;
+      usage = "WINDOW";
+    } else if (cmd == "send") {
+      expected = 2;
+      usage = "WINDOW WORKSPACE";
+    } else if (cmd == "move") {
+      expected = 3;
+      usage = "WINDOW X Y";
+    } else if (cmd == "resize") {
+      expected = 3;
+      usage = "WINDOW WIDTH HEIGHT";
+    } else {
+      return "unknown command: " + cmd;
+    }
+    if (values.size() != expected)
+      return "usage: " + cmd + " " + usage;
+
+    Client *c = clients.find(static_cast<xcb_window_t>(values[0]));
+    if (!c)
+      return "no such client: " + args[1];
+
+    if (cmd == "query") {
+      out += describe_client(*c, c->window == focused_window);
+    } else if (cmd == "focus") {
+      switch_workspace(c->workspace);
+      focus_client(*c);
+    } else if (cmd == "send") {
+      if (values[1] < 1 || values[1] > NUM_WORKSPACES)
+        return "no such workspace: " + args[2];
+      send_to_workspace(*c, static_cast<int>(values[1]) - 1);
+    } else if (cmd == "close") {
+      close_client(*c, XCB_CURRENT_TIME);
+    } else if (c->fullscreen) {
+      return "window is fullscreen";
+    } else if (workspaces[c->workspace].tiling[c->monitor].contains(
+                   c->frame)) {
+      if (cmd == "move")
+        return "window is tiled";
+      workspaces[c->workspace].tiling[c->monitor].resize(
+          c->frame, static_cast<int>(values[1]) - c->width,
+          static_cast<int>(values[2]) - c->height);
+    } else if (cmd == "move") {
+      c->x = static_cast<int>(values[1]);
+      c->y = static_cast<int>(values[2]);
+      configure_client(conn.get(), *c);
+    } else if (cmd == "resize") {
+      c->width = std::max(static_cast<int>(values[1]), MIN_WIDTH);
+      c->height = std::max(static_cast<int>(values[2]), MIN_HEIGHT);
+      configure_client(conn.get(), *c);
+      mark_dirty(*c, DIRTY_SIZE);
+    }
+    return "";
+  };
+
+  IpcServer ipc(loop, run_command);
+  if (ipc_path && !ipc.listen(ipc_path))
+    return 1;
+
+  loop.watch_fd(xcb_get_file_descriptor(conn.get()), []() {});
+  loop.set_idle(process_x);
+  loop.watch_signal(SIGINT, [&]() { loop.stop(); });
+  loop.watch_signal(SIGTERM, [&]() { loop.stop(); });
+  if (stats_enabled)
+    loop.watch_signal(SIGUSR1, [&]() { stats_dump(conn.get()); });
+  loop.watch_signal(SIGHUP, [&]() {
+    restart_requested = true;
+    loop.stop();
+  });
+
+  // Exec-in-place restart (SIGHUP or the "restart" command): the state
+  // goes into a memfd inherited by the new process, and RetainPermanent
+  // keeps our frames, GCs and pixmaps alive once this connection closes.
+  // Windows never leave their frames, so nothing on screen changes.
+  auto restart = [&]() {
+    if (!pending_manage.empty())
+      manage_pending();
+    end_cycle();
+
+    Snapshot snapshot;
+    client_order.for_each(clients, [&](Client &c) {
+      // Alarms are per connection; the successor creates its own.
+      destroy_sync_alarm(conn.get(), c);
+      snapshot.clients.push_back(c);
+    });
+    stacking.for_each(clients, [&](const Client &c) {
+      snapshot.stacking.push_back(c.frame);
+    });
+    for (Workspace &ws : workspaces) {
+      ws.focus.for_each(clients, [&](const Client &c) {
+        snapshot.focus_order.push_back(c.window);
+      });
+    }
+    snapshot.focused_window = focused_window;
+    snapshot.current_workspace = current_workspace;
+
+    int fd = memfd_create("wm-snapshot", 0);
+    if (fd < 0 || !snapshot_write(fd, snapshot)) {
+      LOG_ERROR("Failed to write the restart snapshot");
+      if (fd >= 0)
+        close(fd);
+      return;
+    }
+
+    // ButtonPress and SubstructureRedirect can only be selected by one
+    // client at a time, and the retained selections would otherwise keep
+    // them from the successor.
+    uint32_t no_events = 0;
+    xcb_change_window_attributes(conn.get(), screen->root, XCB_CW_EVENT_MASK,
+                                 &no_events);
+    xcb_ungrab_key(conn.get(), XCB_GRAB_ANY, screen->root, XCB_MOD_MASK_ANY);
+    for (const Client &c : clients) {
+      xcb_change_window_attributes(conn.get(), c.frame, XCB_CW_EVENT_MASK,
+                                   &no_events);
+      xcb_change_window_attributes(conn.get(), c.titlebar, XCB_CW_EVENT_MASK,
+                                   &no_events);
+      xcb_change_window_attributes(conn.get(), c.window, XCB_CW_EVENT_MASK,
+                                   &no_events);
+      xcb_ungrab_button(conn.get(), XCB_BUTTON_INDEX_1, c.window,
+                        XCB_MOD_MASK_ANY);
+    }
+    // The successor makes its own cursors and check window; retained, these
+    // would outlive every WM. Frames, titlebar pixmaps and GCs are handed
+    // over in the snapshot and freed by whoever unmanages the client.
+    free_cursors(conn.get(), cursors);
+    ewmh.release(conn.get());
+    xcb_set_close_down_mode(conn.get(), XCB_CLOSE_DOWN_RETAIN_PERMANENT);
+
+    // Everything above must be processed before the connection drops.
+    stats_round_trip();
+    free(xcb_get_input_focus_reply(conn.get(),
+                                   xcb_get_input_focus(conn.get()), nullptr));
+
+    // The trace ends at the restart: the successor is not passed --record,
+    // which would truncate it.
+    trace.flush();
+    std::vector<std::string> args;
+    for (int i = 0; i < argc; i++) {
+      std::string arg = argv[i];
+      if ((arg == "--snapshot" || arg == "--record") && i + 1 < argc)
+        i++;
+      else
+        args.push_back(argv[i]);
+    }
+    args.push_back("--snapshot");
+    args.push_back(std::to_string(fd));
+
+    std::vector<char *> exec_argv;
+    for (std::string &arg : args)
+      exec_argv.push_back(&arg[0]);
+    exec_argv.push_back(nullptr);
+
+    LOG_INFO("Restarting with %zu clients", snapshot.clients.size());
+    log_drain();
+    fcntl(xcb_get_file_descriptor(conn.get()), F_SETFD, FD_CLOEXEC);
+    execvp(exec_argv[0], exec_argv.data());
+
+    // Still here: take everything back and keep running.
+    LOG_ERROR("Failed to exec %s", exec_argv[0]);
+    close(fd);
+    xcb_set_close_down_mode(conn.get(), XCB_CLOSE_DOWN_DESTROY_ALL);
+    cursors = load_cursors(conn.get(), screen);
+    xcb_change_window_attributes(conn.get(), screen->root, XCB_CW_EVENT_MASK,
+                                 root_events);
+    grab_keys();
+    ewmh.init(conn.get(), atoms, screen->root, NUM_WORKSPACES);
+    for (const Client &c : clients)
+      select_client_events(c);
+  };
+
+  while (true) {
+    loop.run();
+    if (!restart_requested)
+      break;
+    restart_requested = false;
+    restart();
   }
 
+  // Gives every window back as a top-level one. Frames inherited over a
+  // restart belong to the predecessor's retained connection, so neither
+  // closing ours nor the save-set would take them down.
+  for (Client &c : clients) {
+    xcb_reparent_window(conn.get(), c.window, screen->root,
+                        c.x + FRAME_BORDER,
+                        c.y + FRAME_BORDER + TITLE_HEIGHT);
+    destroy_frame(c);
+  }
+  xcb_flush(conn.get());
+
   return 0;
 }
\ No newline at end of file
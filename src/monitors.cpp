@@ -0,0 +1,128 @@
+#include "monitors.h"
+#include "stats.h"
+#include <algorithm>
+#include <cstdlib>
+
+bool RandrExtension::init(xcb_connection_t *conn, xcb_window_t root) {
+  const xcb_query_extension_reply_t *ext =
+      xcb_get_extension_data(conn, &xcb_randr_id);
+  if (!ext || !ext->present)
+    return false;
+
+  stats_round_trip();
+  xcb_randr_query_version_reply_t *reply = xcb_randr_query_version_reply(
+      conn, xcb_randr_query_version(conn, 1, 5), nullptr);
+  if (!reply)
+    return false;
+  bool monitors = reply->major_version > 1 ||
+                  (reply->major_version == 1 && reply->minor_version >= 5);
+  free(reply);
+  if (!monitors)
+    return false;
+
+  xcb_randr_select_input(conn, root, XCB_RANDR_NOTIFY_MASK_SCREEN_CHANGE);
+
+  present = true;
+  first_event = ext->first_event;
+  return true;
+}
+
+std::vector<Rect> query_monitors(xcb_connection_t *conn, xcb_window_t root,
+                                 const RandrExtension &randr, int root_width,
+                                 int root_height) {
+  std::vector<Rect> monitors;
+
+  if (randr.present) {
+    stats_round_trip();
+    xcb_randr_get_monitors_reply_t *reply = xcb_randr_get_monitors_reply(
+        conn, xcb_randr_get_monitors(conn, root, 1), nullptr);
+    if (reply) {
+      xcb_randr_monitor_info_iterator_t it =
+          xcb_randr_get_monitors_monitors_iterator(reply);
+      for (; it.rem; xcb_randr_monitor_info_next(&it)) {
+        const xcb_randr_monitor_info_t *m = it.data;
+        Rect rect = {m->x, m->y, m->width, m->height};
+        if (m->primary)
+          monitors.insert(monitors.begin(), rect);
+        else
+          monitors.push_back(rect);
+      }
+      free(reply);
+    }
+  }
+
+  if (monitors.empty())
+    monitors.push_back({0, 0, root_width, root_height});
+  return monitors;
+}
+
+void MonitorIndex::set(const std::vector<Rect> &monitors, int root_width,
+                       int root_height) {
+  std::vector<int> xs = {0, root_width};
+  std::vector<int> ys = {0, root_height};
+  for (const Rect &m : monitors) {
+    xs.push_back(std::min(std::max(m.x, 0), root_width));
+    xs.push_back(std::min(std::max(m.x + m.width, 0), root_width));
+    ys.push_back(std::min(std::max(m.y, 0), root_height));
+    ys.push_back(std::min(std::max(m.y + m.height, 0), root_height));
+  }
+  std::sort(xs.begin(), xs.end());
+  xs.erase(std::unique(xs.begin(), xs.end()), xs.end());
+  std::sort(ys.begin(), ys.end());
+  ys.erase(std::unique(ys.begin(), ys.end()), ys.end());
+
+  column_.assign(root_width, 0);
+  for (size_t k = 0; k + 1 < xs.size(); k++)
+    std::fill(column_.begin() + xs[k], column_.begin() + xs[k + 1], k);
+  row_.assign(root_height, 0);
+  for (size_t k = 0; k + 1 < ys.size(); k++)
+    std::fill(row_.begin() + ys[k], row_.begin() + ys[k + 1], k);
+
+  rows_ = ys.size() > 1 ? ys.size() - 1 : 1;
+  size_t columns = xs.size() > 1 ? xs.size() - 1 : 1;
+  cell_monitor_.assign(columns * rows_, 0);
+
+  for (size_t k = 0; k + 1 < xs.size(); k++) {
+    for (size_t l = 0; l + 1 < ys.size(); l++) {
+      // Cells never straddle a monitor edge, so testing the center decides
+      // the whole cell.
+      int cx = (xs[k] + xs[k + 1]) / 2;
+      int cy = (ys[l] + ys[l + 1]) / 2;
+      int found = -1;
+      long best_distance = -1;
+      for (size_t i = 0; i < monitors.size() && found < 0; i++) {
+        const Rect &m = monitors[i];
+        int dx = std::max({m.x - cx, 0, cx - (m.x + m.width - 1)});
+        int dy = std::max({m.y - cy, 0, cy - (m.y + m.height - 1)});
+        long distance =
+            static_cast<long>(dx) * dx + static_cast<long>(dy) * dy;
+        if (distance == 0)
+          found = static_cast<int>(i);
+        else if (best_distance < 0 || distance < best_distance) {
+          best_distance = distance;
+          cell_monitor_[k * rows_ + l] = -1 - static_cast<int>(i);
+        }
+      }
+      if (found >= 0)
+        cell_monitor_[k * rows_ + l] = found;
+    }
+  }
+}
+
+int MonitorIndex::at(int x, int y) const {
+  if (column_.empty() || row_.empty())
+    return 0;
+  x = std::min(std::max(x, 0), static_cast<int>(column_.size()) - 1);
+  y = std::min(std::max(y, 0), static_cast<int>(row_.size()) - 1);
+  int cell = cell_monitor_[column_[x] * rows_ + row_[y]];
+  return cell >= 0 ? cell : -1 - cell;
+}
+
+bool MonitorIndex::covered(int x, int y) const {
+  if (column_.empty() || row_.empty())
+    return false;
+  if (x < 0 || y < 0 || x >= static_cast<int>(column_.size()) ||
+      y >= static_cast<int>(row_.size()))
+    return false;
+  return cell_monitor_[column_[x] * rows_ + row_[y]] >= 0;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "placement.h"
+#include <cstdint>
+#include <vector>
+#include <xcb/randr.h>
+#include <xcb/xcb.h>
+
+// Presence and event base of RandR (1.5, for monitor objects).
+struct RandrExtension {
+  bool present = false;
+  uint8_t first_event = 0;
+
+  // Also selects RRScreenChangeNotify on root.
+  bool init(xcb_connection_t *conn, xcb_window_t root);
+};
+
+// The active monitors, primary first. Without RandR, or if it reports
+// none, the whole root is one monitor.
+std::vector<Rect> query_monitors(xcb_connection_t *conn, xcb_window_t root,
+                                 const RandrExtension &randr, int root_width,
+                                 int root_height);
+
+// Constant-time "which monitor is this point on". The root is cut into a
+// grid along every monitor edge; two per-pixel tables map a coordinate to
+// its grid column and row, and each cell records its monitor. Cells not
+// covered by any monitor (and points off the root) resolve to the nearest
+// one, so a lookup always lands somewhere usable.
+class MonitorIndex {
+public:
+  void set(const std::vector<Rect> &monitors, int root_width,
+           int root_height);
+
+  // Index into the monitors passed to set(); 0 if there are none.
+  int at(int x, int y) const;
+
+  // True if (x, y) lies on a monitor rather than between them.
+  bool covered(int x, int y) const;
+
+private:
+  std::vector<uint16_t> column_;
+  std::vector<uint16_t> row_;
+  std::vector<int> cell_monitor_; // column-major, -1 - nearest if uncovered
+  size_t rows_ = 0;
+};
@@ -0,0 +1,207 @@
+#include "placement.h"
+#include <algorithm>
+#include <tuple>
+
+namespace {
+
+int right(const Rect &r) { return r.x + r.width; }
+int bottom(const Rect &r) { return r.y + r.height; }
+
+bool intersects(const Rect &a, const Rect &b) {
+  return a.x < right(b) && b.x < right(a) && a.y < bottom(b) &&
+         b.y < bottom(a);
+}
+
+bool contains(const Rect &outer, const Rect &inner) {
+  return inner.x >= outer.x && inner.y >= outer.y &&
+         right(inner) <= right(outer) && bottom(inner) <= bottom(outer);
+}
+
+// Maximal-rectangles split: every rectangle of rects overlapping used is
+// replaced by up to four pieces around it. Rectangles it does not touch
+// were maximal before and still are, so only the new pieces need checking
+// for containment. With a clip, pieces not overlapping it are dropped.
+void split(std::vector<Rect> &rects, const Rect &used, const Rect *clip) {
+  std::vector<Rect> pieces;
+  for (size_t i = 0; i < rects.size();) {
+    if (!intersects(rects[i], used)) {
+      i++;
+      continue;
+    }
+    Rect f = rects[i];
+    rects[i] = rects.back();
+    rects.pop_back();
+
+    if (used.x > f.x)
+      pieces.push_back({f.x, f.y, used.x - f.x, f.height});
+    if (right(used) < right(f))
+      pieces.push_back({right(used), f.y, right(f) - right(used), f.height});
+    if (used.y > f.y)
+      pieces.push_back({f.x, f.y, f.width, used.y - f.y});
+    if (bottom(used) < bottom(f))
+      pieces.push_back({f.x, bottom(used), f.width, bottom(f) - bottom(used)});
+  }
+
+  size_t kept = rects.size();
+  for (size_t i = 0; i < pieces.size(); i++) {
+    const Rect &p = pieces[i];
+    bool redundant = clip && !intersects(p, *clip);
+    for (size_t j = 0; j < kept && !redundant; j++)
+      redundant = contains(rects[j], p);
+    // Of two identical pieces, keep the first.
+    for (size_t j = 0; j < pieces.size() && !redundant; j++) {
+      if (j != i && contains(pieces[j], p))
+        redundant = !contains(p, pieces[j]) || j < i;
+    }
+    if (!redundant)
+      rects.push_back(p);
+  }
+}
+
+} // namespace
+
+void Placement::set_areas(const std::vector<Rect> &areas) {
+  areas_ = areas;
+  stale_ = true;
+}
+
+void Placement::set(uint32_t id, Rect rect) {
+  auto it = occupied_.find(id);
+  if (it == occupied_.end()) {
+    occupied_.emplace(id, rect);
+    if (!stale_)
+      occupy(rect);
+    return;
+  }
+
+  Rect &old = it->second;
+  if (old.x == rect.x && old.y == rect.y && old.width == rect.width &&
+      old.height == rect.height)
+    return;
+  // Only the first move since the last placement is kept: that is where
+  // free_ has the window.
+  if (!stale_)
+    moved_.emplace(id, old);
+  old = rect;
+}
+
+void Placement::remove(uint32_t id) {
+  auto it = occupied_.find(id);
+  if (it == occupied_.end())
+    return;
+  if (!stale_)
+    moved_.emplace(id, it->second);
+  occupied_.erase(it);
+}
+
+void Placement::find(int width, int height, int preferred, int &x, int &y) {
+  if (stale_)
+    rebuild();
+  else
+    apply_moves();
+
+  const Rect *home = nullptr;
+  if (preferred >= 0 && preferred < static_cast<int>(areas_.size()))
+    home = &areas_[preferred];
+
+  const Rect *best = nullptr;
+  std::tuple<bool, int, int, int, int> best_score;
+  for (const Rect &f : free_) {
+    if (f.width < width || f.height < height)
+      continue;
+    int dw = f.width - width;
+    int dh = f.height - height;
+    bool elsewhere = home && !contains(*home, f);
+    auto score = std::make_tuple(elsewhere, std::min(dw, dh), std::max(dw, dh),
+                                 f.y, f.x);
+    if (!best || score < best_score) {
+      best = &f;
+      best_score = score;
+    }
+  }
+
+  if (!best) {
+    long best_area = -1;
+    for (const Rect &f : free_) {
+      long area = static_cast<long>(f.width) * f.height;
+      if (area > best_area) {
+        best = &f;
+        best_area = area;
+      }
+    }
+  }
+
+  if (!home && !areas_.empty())
+    home = &areas_[0];
+  x = best ? best->x : home ? home->x : 0;
+  y = best ? best->y : home ? home->y : 0;
+}
+
+void Placement::rebuild() {
+  free_.clear();
+  for (const Rect &area : areas_) {
+    if (area.width > 0 && area.height > 0)
+      free_.push_back(area);
+  }
+  for (const auto &entry : occupied_)
+    occupy(entry.second);
+  moved_.clear();
+  stale_ = false;
+}
+
+// Each release walks every window once; when many have moved, one pass
+// over all of them from scratch is cheaper.
+void Placement::apply_moves() {
+  if (moved_.empty())
+    return;
+  if (moved_.size() > occupied_.size() / 4 + 1) {
+    rebuild();
+    return;
+  }
+  for (const auto &entry : moved_) {
+    release(entry.second);
+    auto it = occupied_.find(entry.first);
+    if (it != occupied_.end())
+      occupy(it->second);
+  }
+  moved_.clear();
+}
+
+void Placement::occupy(const Rect &used) { split(free_, used, nullptr); }
+
+// Frees the area a window left. Free space only grows, so every rectangle
+// in free_ stays free; the new maximal rectangles are the ones overlapping
+// freed. Those come out of the same splitting rebuild() does, seeded with
+// just the areas freed lies in, and dropping every piece that no longer
+// overlaps it: such a piece only shrinks further and could never contain
+// one of them. Old rectangles inside a new one are then no longer maximal.
+void Placement::release(const Rect &freed) {
+  std::vector<Rect> found;
+  for (const Rect &area : areas_) {
+    if (area.width > 0 && area.height > 0 && intersects(area, freed))
+      found.push_back(area);
+  }
+  for (const auto &entry : occupied_) {
+    if (found.empty())
+      return;
+    split(found, entry.second, &freed);
+  }
+
+  auto inside_found = [&](const Rect &f) {
+    for (const Rect &n : found) {
+      if (contains(n, f))
+        return true;
+    }
+    return false;
+  };
+  free_.erase(std::remove_if(free_.begin(), free_.end(), inside_found),
+              free_.end());
+  size_t kept = free_.size();
+  for (const Rect &n : found) {
+    bool redundant = false;
+    for (size_t j = 0; j < kept && !redundant; j++)
+      redundant = contains(free_[j], n);
+    if (!redundant)
+      free_.push_back(n);
+  }
+}
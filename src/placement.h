@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+struct Rect {
+  int x, y;
+  int width, height;
+};
+
+// Free-space index for placing new windows, kept as the set of maximal
+// free rectangles of the work areas. Adding a window splits only the free
+// rectangles it overlaps. Moves and removals are queued, since windows
+// move far more often than new ones appear, and applied the next time a
+// window is placed: the area a window left is released by recomputing
+// only the maximal rectangles that overlap it.
+class Placement {
+public:
+  // The areas windows are placed in (one per monitor), in root
+  // coordinates. Free rectangles never span two areas.
+  void set_areas(const std::vector<Rect> &areas);
+
+  // Records (or updates) the rectangle occupied by window id.
+  void set(uint32_t id, Rect rect);
+  void remove(uint32_t id);
+
+  // Returns the top-left corner for a width x height window: the tightest
+  // free rectangle that fits it (best short side fit, ties broken towards
+  // the top left), preferring ones in areas[preferred]. When nothing fits,
+  // the corner of the largest free rectangle.
+  void find(int width, int height, int preferred, int &x, int &y);
+
+private:
+  void rebuild();
+  void apply_moves();
+  void occupy(const Rect &used);
+  void release(const Rect &freed);
+
+  std::vector<Rect> areas_;
+  bool stale_ = true;
+  std::vector<Rect> free_;
+  std::unordered_map<uint32_t, Rect> occupied_;
+  // Windows moved or removed since free_ was brought up to date, with the
+  // rectangle free_ still has them at.
+  std::unordered_map<uint32_t, Rect> moved_;
+};
@@ -0,0 +1,66 @@
+#include "resize_sync.h"
+#include "stats.h"
+#include <cstdlib>
+
+bool SyncExtension::init(xcb_connection_t *conn) {
+  const xcb_query_extension_reply_t *ext =
+      xcb_get_extension_data(conn, &xcb_sync_id);
+  if (!ext || !ext->present)
+    return false;
+
+  stats_round_trip();
+  xcb_sync_initialize_reply_t *reply = xcb_sync_initialize_reply(
+      conn, xcb_sync_initialize(conn, 3, 1), nullptr);
+  if (!reply)
+    return false;
+  free(reply);
+
+  present = true;
+  first_event = ext->first_event;
+  return true;
+}
+
+void send_sync_request(xcb_connection_t *conn, const Atoms &atoms, Client &c,
+                       xcb_timestamp_t time) {
+  c.sync_value++;
+  uint32_t hi = static_cast<uint32_t>(c.sync_value >> 32);
+  uint32_t lo = static_cast<uint32_t>(c.sync_value);
+
+  if (c.sync_alarm == XCB_NONE) {
+    c.sync_alarm = xcb_generate_id(conn);
+    uint32_t vals[] = {c.sync_counter,
+                       XCB_SYNC_VALUETYPE_ABSOLUTE,
+                       hi,
+                       lo,
+                       XCB_SYNC_TESTTYPE_POSITIVE_COMPARISON,
+                       1};
+    xcb_sync_create_alarm(conn, c.sync_alarm,
+                          XCB_SYNC_CA_COUNTER | XCB_SYNC_CA_VALUE_TYPE |
+                              XCB_SYNC_CA_VALUE | XCB_SYNC_CA_TEST_TYPE |
+                              XCB_SYNC_CA_EVENTS,
+                          vals);
+  } else {
+    uint32_t vals[] = {hi, lo};
+    xcb_sync_change_alarm(conn, c.sync_alarm, XCB_SYNC_CA_VALUE, vals);
+  }
+
+  xcb_client_message_event_t ev = {};
+  ev.response_type = XCB_CLIENT_MESSAGE;
+  ev.format = 32;
+  ev.window = c.window;
+  ev.type = atoms.wm_protocols;
+  ev.data.data32[0] = atoms.net_wm_sync_request;
+  ev.data.data32[1] = time;
+  ev.data.data32[2] = lo;
+  ev.data.data32[3] = hi;
+
+  xcb_send_event(conn, 0, c.window, XCB_EVENT_MASK_NO_EVENT,
+                 reinterpret_cast<const char *>(&ev));
+}
+
+void destroy_sync_alarm(xcb_connection_t *conn, Client &c) {
+  if (c.sync_alarm == XCB_NONE)
+    return;
+  xcb_sync_destroy_alarm(conn, c.sync_alarm);
+  c.sync_alarm = XCB_NONE;
+}
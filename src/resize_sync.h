@@ -0,0 +1,21 @@
+#pragma once
+
+#include "atoms.h"
+#include "client.h"
+#include <xcb/sync.h>
+#include <xcb/xcb.h>
+
+// Presence and event base of the XSync extension on this display.
+struct SyncExtension {
+  bool present = false;
+  uint8_t first_event = 0;
+
+  bool init(xcb_connection_t *conn);
+};
+
+// Sends c a _NET_WM_SYNC_REQUEST for its next configure and arms c's
+// alarm to fire once the client bumps its counter to the new value.
+void send_sync_request(xcb_connection_t *conn, const Atoms &atoms, Client &c,
+                       xcb_timestamp_t time);
+
+void destroy_sync_alarm(xcb_connection_t *conn, Client &c);
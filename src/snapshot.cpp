@@ -0,0 +1,165 @@
+#include "snapshot.h"
+#include <cstring>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const uint32_t SNAPSHOT_MAGIC = 0x534d5706; // "\1WMS", bumped per format
+
+// Fields are copied in host byte order: a snapshot only ever travels
+// between two processes on the same machine.
+class Writer {
+public:
+  template <typename T> void put(const T &value) {
+    out_.append(reinterpret_cast<const char *>(&value), sizeof(value));
+  }
+  void put(const std::string &str) {
+    put(static_cast<uint32_t>(str.size()));
+    out_ += str;
+  }
+  const std::string &data() const { return out_; }
+
+private:
+  std::string out_;
+};
+
+class Reader {
+public:
+  explicit Reader(const std::string &in) : in_(in) {}
+
+  template <typename T> bool get(T &value) {
+    if (in_.size() - pos_ < sizeof(value))
+      return false;
+    memcpy(&value, in_.data() + pos_, sizeof(value));
+    pos_ += sizeof(value);
+    return true;
+  }
+  bool get(std::string &str) {
+    uint32_t size;
+    if (!get(size) || in_.size() - pos_ < size)
+      return false;
+    str.assign(in_, pos_, size);
+    pos_ += size;
+    return true;
+  }
+
+private:
+  const std::string &in_;
+  size_t pos_ = 0;
+};
+
+} // namespace
+
+bool snapshot_write(int fd, const Snapshot &s) {
+  Writer w;
+  w.put(SNAPSHOT_MAGIC);
+  w.put(s.focused_window);
+  w.put(s.current_workspace);
+
+  w.put(static_cast<uint32_t>(s.clients.size()));
+  for (const Client &c : s.clients) {
+    w.put(c.frame);
+    w.put(c.titlebar);
+    w.put(c.window);
+    w.put(c.titlebar_gc);
+    w.put(c.x);
+    w.put(c.y);
+    w.put(c.width);
+    w.put(c.height);
+    w.put(c.title);
+    w.put(c.titlebar_pixmaps[0]);
+    w.put(c.titlebar_pixmaps[1]);
+    w.put(c.pixmap_width);
+    w.put(c.pixmap_title);
+    w.put(c.sync_counter);
+    w.put(c.sync_value);
+    w.put(c.workspace);
+    w.put(c.supports_delete);
+    w.put(c.fullscreen);
+    w.put(c.saved_x);
+    w.put(c.saved_y);
+    w.put(c.saved_width);
+    w.put(c.saved_height);
+  }
+
+  w.put(static_cast<uint32_t>(s.stacking.size()));
+  for (xcb_window_t frame : s.stacking)
+    w.put(frame);
+
+  w.put(static_cast<uint32_t>(s.focus_order.size()));
+  for (xcb_window_t window : s.focus_order)
+    w.put(window);
+
+  const std::string &data = w.data();
+  size_t written = 0;
+  while (written < data.size()) {
+    ssize_t n = write(fd, data.data() + written, data.size() - written);
+    if (n <= 0)
+      return false;
+    written += n;
+  }
+  return true;
+}
+
+bool snapshot_read(int fd, int workspaces, Snapshot &s) {
+  struct stat st;
+  if (fstat(fd, &st) < 0)
+    return false;
+
+  std::string data(st.st_size, '\0');
+  size_t done = 0;
+  while (done < data.size()) {
+    ssize_t n = pread(fd, &data[done], data.size() - done, done);
+    if (n <= 0)
+      return false;
+    done += n;
+  }
+
+  Reader r(data);
+  uint32_t magic;
+  if (!r.get(magic) || magic != SNAPSHOT_MAGIC)
+    return false;
+  if (!r.get(s.focused_window) || !r.get(s.current_workspace) ||
+      s.current_workspace < 0 || s.current_workspace >= workspaces)
+    return false;
+
+  uint32_t count;
+  if (!r.get(count))
+    return false;
+  for (uint32_t i = 0; i < count; i++) {
+    Client c;
+    if (!r.get(c.frame) || !r.get(c.titlebar) || !r.get(c.window) ||
+        !r.get(c.titlebar_gc) || !r.get(c.x) || !r.get(c.y) ||
+        !r.get(c.width) || !r.get(c.height) || !r.get(c.title) ||
+        !r.get(c.titlebar_pixmaps[0]) || !r.get(c.titlebar_pixmaps[1]) ||
+        !r.get(c.pixmap_width) || !r.get(c.pixmap_title) ||
+        !r.get(c.sync_counter) || !r.get(c.sync_value) ||
+        !r.get(c.workspace) || !r.get(c.supports_delete) ||
+        !r.get(c.fullscreen) || !r.get(c.saved_x) || !r.get(c.saved_y) ||
+        !r.get(c.saved_width) || !r.get(c.saved_height) ||
+        c.workspace >= workspaces)
+      return false;
+    s.clients.push_back(c);
+  }
+
+  if (!r.get(count))
+    return false;
+  for (uint32_t i = 0; i < count; i++) {
+    xcb_window_t frame;
+    if (!r.get(frame))
+      return false;
+    s.stacking.push_back(frame);
+  }
+
+  if (!r.get(count))
+    return false;
+  for (uint32_t i = 0; i < count; i++) {
+    xcb_window_t window;
+    if (!r.get(window))
+      return false;
+    s.focus_order.push_back(window);
+  }
+  return true;
+}
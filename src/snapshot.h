@@ -0,0 +1,26 @@
+#pragma once
+
+#include "client.h"
+#include <vector>
+#include <xcb/xcb.h>
+
+// WM state handed from one process to the next across an exec-in-place
+// restart. The X resources it names (frames, titlebars, GCs, pixmaps) stay
+// alive because the old process closes with RetainPermanent.
+struct Snapshot {
+  std::vector<Client> clients; // in _NET_CLIENT_LIST order
+  std::vector<xcb_window_t> stacking;
+  // Client windows, each workspace's most recently focused first.
+  std::vector<xcb_window_t> focus_order;
+  xcb_window_t focused_window = XCB_NONE;
+  int current_workspace = 0;
+};
+
+// Writes s to fd as one binary blob, for the same binary version to read
+// back. Returns false on a short write.
+bool snapshot_write(int fd, const Snapshot &s);
+
+// Reads a snapshot from the start of fd. Returns false if fd does not hold
+// a complete snapshot of this format, or if it names a workspace outside
+// [0, workspaces); s is then left partly filled.
+bool snapshot_read(int fd, int workspaces, Snapshot &s);
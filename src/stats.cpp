@@ -0,0 +1,138 @@
+#include "stats.h"
+#include "event_names.h"
+#include "log.h"
+#include <cstdio>
+#include <ctime>
+#include <string>
+
+bool stats_enabled = false;
+StatsCounters stats_counters;
+
+namespace {
+
+// Bucket i counts handling times in [2^(i-1), 2^i) ns; bucket 0 is < 1 ns.
+constexpr int HISTOGRAM_BUCKETS = 40;
+
+struct EventStats {
+  uint64_t count = 0;
+  uint64_t total_ns = 0;
+  uint64_t max_ns = 0;
+  uint64_t buckets[HISTOGRAM_BUCKETS] = {};
+};
+
+EventStats event_stats[256];
+EventStats switch_stats;
+std::string dump_path;
+
+// Requests issued, from the sequence numbers XCB assigns them (32 bits,
+// so differences across a wrap still come out right).
+uint64_t requests = 0;
+uint32_t last_sequence = 0;
+
+int bucket_for(uint64_t ns) {
+  int bucket = ns ? 64 - __builtin_clzll(ns) : 0;
+  return bucket < HISTOGRAM_BUCKETS ? bucket : HISTOGRAM_BUCKETS - 1;
+}
+
+void record(EventStats &s, uint64_t elapsed_ns) {
+  s.count++;
+  s.total_ns += elapsed_ns;
+  if (elapsed_ns > s.max_ns)
+    s.max_ns = elapsed_ns;
+  s.buckets[bucket_for(elapsed_ns)]++;
+}
+
+// Upper bound of the bucket holding the given quantile, in microseconds.
+double quantile_us(const EventStats &s, double q) {
+  uint64_t target = static_cast<uint64_t>(q * s.count);
+  uint64_t seen = 0;
+  for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    seen += s.buckets[i];
+    if (seen > target)
+      return static_cast<double>(1ull << i) / 1000.0;
+  }
+  return s.max_ns / 1000.0;
+}
+
+void print_row(FILE *out, const char *name, const EventStats &s) {
+  fprintf(out, "%-18s %10llu %10.2f %10.2f %10.2f %10.2f\n", name,
+          static_cast<unsigned long long>(s.count),
+          s.total_ns / 1000.0 / s.count, quantile_us(s, 0.5),
+          quantile_us(s, 0.99), s.max_ns / 1000.0);
+
+  fprintf(out, "  buckets_ns");
+  for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    if (s.buckets[i])
+      fprintf(out, " <%llu:%llu", 1ull << i,
+              static_cast<unsigned long long>(s.buckets[i]));
+  }
+  fprintf(out, "\n");
+}
+
+} // namespace
+
+void stats_enable(const char *path) {
+  stats_enabled = true;
+  dump_path = path;
+}
+
+uint64_t stats_now_ns() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+void stats_flush(xcb_connection_t *conn) {
+  stats_counters.flushes++;
+  if (!stats_enabled)
+    return;
+  uint32_t sequence = xcb_no_operation(conn).sequence;
+  requests += sequence - last_sequence - 1;
+  last_sequence = sequence;
+}
+
+void stats_event(const xcb_generic_event_t *event, uint64_t elapsed_ns) {
+  record(event_stats[event->response_type & ~0x80], elapsed_ns);
+}
+
+void stats_workspace_switch(uint64_t elapsed_ns) {
+  record(switch_stats, elapsed_ns);
+}
+
+void stats_dump(xcb_connection_t *conn) {
+  FILE *out = fopen(dump_path.c_str(), "w");
+  if (!out) {
+    LOG_WARN("Cannot write stats to %s", dump_path.c_str());
+    return;
+  }
+
+  fprintf(out, "requests %llu\n", static_cast<unsigned long long>(requests));
+  fprintf(out, "round_trips %llu\n",
+          static_cast<unsigned long long>(stats_counters.round_trips));
+  fprintf(out, "flushes %llu\n",
+          static_cast<unsigned long long>(stats_counters.flushes));
+  fprintf(out, "bytes_written %llu\n",
+          static_cast<unsigned long long>(xcb_total_written(conn)));
+  fprintf(out, "bytes_read %llu\n",
+          static_cast<unsigned long long>(xcb_total_read(conn)));
+
+  fprintf(out, "\n%-18s %10s %10s %10s %10s %10s\n", "event", "count",
+          "mean_us", "p50_us", "p99_us", "max_us");
+  for (int type = 0; type < 256; type++) {
+    const EventStats &s = event_stats[type];
+    if (!s.count)
+      continue;
+
+    char name[32];
+    if (const char *known = event_name(type))
+      snprintf(name, sizeof(name), "%s", known);
+    else
+      snprintf(name, sizeof(name), "extension_%d", type);
+    print_row(out, name, s);
+  }
+  if (switch_stats.count)
+    print_row(out, "WorkspaceSwitch", switch_stats);
+
+  fclose(out);
+  LOG_INFO("Stats written to %s", dump_path.c_str());
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <xcb/xcb.h>
+
+// Event loop instrumentation. Counters are always maintained since an
+// increment is cheaper than checking whether to do it; per-event timing
+// is only taken when stats_enabled is set (--stats FILE).
+struct StatsCounters {
+  uint64_t round_trips = 0; // blocking *_reply calls
+  uint64_t flushes = 0;
+};
+
+extern bool stats_enabled;
+extern StatsCounters stats_counters;
+
+inline void stats_round_trip() { stats_counters.round_trips++; }
+
+// Counts a flush; call it right before xcb_flush. With --stats it also
+// counts the requests issued since the previous one. XCB keeps that count
+// to itself, so a NoOperation is issued to read it from the cookie's
+// sequence number; those are left out of the count.
+void stats_flush(xcb_connection_t *conn);
+
+// Enables timing; stats_dump() writes to path. The event loop calls it on
+// SIGUSR1.
+void stats_enable(const char *path);
+
+uint64_t stats_now_ns();
+
+// Records one handled event (or error) and how long handling it took.
+void stats_event(const xcb_generic_event_t *event, uint64_t elapsed_ns);
+
+// Records one workspace switch, until the server had processed it.
+void stats_workspace_switch(uint64_t elapsed_ns);
+
+// Writes the counters and per-event histograms to the --stats file.
+void stats_dump(xcb_connection_t *conn);
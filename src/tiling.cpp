@@ -0,0 +1,178 @@
+#include "tiling.h"
+#include <algorithm>
+
+namespace {
+
+// Splits are kept from squeezing either side out of existence.
+const double MIN_RATIO = 0.05;
+const double MAX_RATIO = 0.95;
+
+bool same_rect(const Rect &a, const Rect &b) {
+  return a.x == b.x && a.y == b.y && a.width == b.width &&
+         a.height == b.height;
+}
+
+} // namespace
+
+void BspLayout::set_area(Rect area) {
+  area_ = area;
+  if (root_ >= 0)
+    layout(root_, area_);
+}
+
+void BspLayout::insert(uint32_t id, uint32_t near) {
+  if (contains(id))
+    return;
+
+  int leaf = new_node();
+  nodes_[leaf].id = id;
+  leaves_[id] = leaf;
+
+  if (root_ < 0) {
+    root_ = leaf;
+    layout(leaf, area_);
+    return;
+  }
+
+  int target;
+  auto it = leaves_.find(near);
+  if (it != leaves_.end() && it->second != leaf) {
+    target = it->second;
+  } else {
+    target = -1;
+    long best_area = -1;
+    for (const auto &entry : leaves_) {
+      const Rect &r = nodes_[entry.second].rect;
+      long area = static_cast<long>(r.width) * r.height;
+      if (entry.second != leaf && area > best_area) {
+        target = entry.second;
+        best_area = area;
+      }
+    }
+  }
+
+  int split = new_node();
+  Node &s = nodes_[split];
+  s.vertical = nodes_[target].rect.width >= nodes_[target].rect.height;
+  s.child[0] = target;
+  s.child[1] = leaf;
+  s.parent = nodes_[target].parent;
+  replace_child(s.parent, target, split);
+  nodes_[target].parent = split;
+  nodes_[leaf].parent = split;
+
+  layout(split, nodes_[target].rect);
+}
+
+void BspLayout::remove(uint32_t id) {
+  auto it = leaves_.find(id);
+  if (it == leaves_.end())
+    return;
+  int leaf = it->second;
+  leaves_.erase(it);
+
+  int parent = nodes_[leaf].parent;
+  free_nodes_.push_back(leaf);
+  if (parent < 0) {
+    root_ = -1;
+    return;
+  }
+
+  Node &p = nodes_[parent];
+  int sibling = p.child[0] == leaf ? p.child[1] : p.child[0];
+  nodes_[sibling].parent = p.parent;
+  replace_child(p.parent, parent, sibling);
+  free_nodes_.push_back(parent);
+
+  layout(sibling, p.rect);
+}
+
+void BspLayout::resize(uint32_t id, int dw, int dh) {
+  auto it = leaves_.find(id);
+  if (it == leaves_.end())
+    return;
+  if (dw)
+    adjust(it->second, true, dw);
+  if (dh)
+    adjust(it->second, false, dh);
+}
+
+const Rect *BspLayout::tile_of(uint32_t id) const {
+  auto it = leaves_.find(id);
+  return it == leaves_.end() ? nullptr : &nodes_[it->second].rect;
+}
+
+std::vector<BspLayout::Change> BspLayout::take_changes() {
+  std::vector<Change> changes;
+  changes.swap(changes_);
+  return changes;
+}
+
+int BspLayout::new_node() {
+  if (free_nodes_.empty()) {
+    nodes_.emplace_back();
+    return static_cast<int>(nodes_.size()) - 1;
+  }
+  int node = free_nodes_.back();
+  free_nodes_.pop_back();
+  nodes_[node] = Node();
+  return node;
+}
+
+void BspLayout::replace_child(int parent, int old_child, int new_child) {
+  if (parent < 0) {
+    root_ = new_child;
+    return;
+  }
+  Node &p = nodes_[parent];
+  p.child[p.child[0] == old_child ? 0 : 1] = new_child;
+}
+
+void BspLayout::layout(int node, Rect rect) {
+  Node &n = nodes_[node];
+  if (n.child[0] < 0) {
+    if (!same_rect(n.rect, rect))
+      changes_.push_back({n.id, rect});
+    n.rect = rect;
+    return;
+  }
+  n.rect = rect;
+
+  Rect first = rect;
+  Rect second = rect;
+  if (n.vertical) {
+    first.width = static_cast<int>(rect.width * n.ratio + 0.5);
+    second.x = rect.x + first.width;
+    second.width = rect.width - first.width;
+  } else {
+    first.height = static_cast<int>(rect.height * n.ratio + 0.5);
+    second.y = rect.y + first.height;
+    second.height = rect.height - first.height;
+  }
+  int children[2] = {n.child[0], n.child[1]};
+  layout(children[0], first);
+  layout(children[1], second);
+}
+
+// Finds the nearest split along the given axis above leaf and moves its
+// dividing line by delta pixels, away from leaf's side.
+void BspLayout::adjust(int leaf, bool vertical, int delta) {
+  int child = leaf;
+  int split = nodes_[leaf].parent;
+  while (split >= 0 && nodes_[split].vertical != vertical) {
+    child = split;
+    split = nodes_[split].parent;
+  }
+  if (split < 0)
+    return;
+
+  Node &s = nodes_[split];
+  int total = vertical ? s.rect.width : s.rect.height;
+  if (total <= 0)
+    return;
+  int first = static_cast<int>(total * s.ratio + 0.5);
+  first += s.child[0] == child ? delta : -delta;
+  s.ratio = std::min(std::max(static_cast<double>(first) / total, MIN_RATIO),
+                     MAX_RATIO);
+  layout(split, s.rect);
+}
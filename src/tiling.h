@@ -0,0 +1,61 @@
+#pragma once
+
+#include "placement.h"
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Binary space partitioning tiling layout (--tile). Each window is a leaf;
+// inserting one splits an existing tile along its longer side, removing
+// one hands its space to its sibling subtree.
+//
+// Only the subtree whose space changed is laid out again, and only tiles
+// whose rectangle actually differs are reported, so one map or unmap
+// reconfigures O(changed) windows rather than all of them.
+class BspLayout {
+public:
+  using Change = std::pair<uint32_t, Rect>;
+
+  // Sets the tiled area and lays everything out again.
+  void set_area(Rect area);
+
+  // Tiles id by splitting near's tile, or the largest tile if near is not
+  // tiled.
+  void insert(uint32_t id, uint32_t near);
+  void remove(uint32_t id);
+
+  // Moves the edges of id's tile shared with its neighbours so that it
+  // grows by dw/dh (shrinks when negative).
+  void resize(uint32_t id, int dw, int dh);
+
+  bool contains(uint32_t id) const { return leaves_.count(id) != 0; }
+  const Rect *tile_of(uint32_t id) const;
+  size_t size() const { return leaves_.size(); }
+
+  // Tiles whose rectangle changed since the last call, with the new one.
+  std::vector<Change> take_changes();
+
+private:
+  struct Node {
+    int parent = -1;
+    int child[2] = {-1, -1}; // both -1 for a leaf
+    bool vertical = false;   // children side by side
+    double ratio = 0.5;      // share of the first child
+    uint32_t id = 0;         // leaves only
+    Rect rect = {0, 0, -1, -1};
+  };
+
+  int new_node();
+  void replace_child(int parent, int old_child, int new_child);
+  void layout(int node, Rect rect);
+  void adjust(int leaf, bool vertical, int delta);
+
+  Rect area_ = {0, 0, 0, 0};
+  std::vector<Node> nodes_;
+  std::vector<int> free_nodes_;
+  int root_ = -1;
+  std::unordered_map<uint32_t, int> leaves_;
+  std::vector<Change> changes_;
+};
@@ -0,0 +1,170 @@
+#include "trace.h"
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const uint32_t TRACE_MAGIC = 0x54524301; // "\1CRT", bumped per format
+
+// Events are 32 bytes; the time since the previous one is put in front of
+// each as a LEB128 varint of microseconds, a single byte for most of a
+// burst. Everything else is in host byte order, like the snapshot: the
+// replay tool runs where the trace was taken.
+void put_varint(std::string &out, uint64_t value) {
+  while (value >= 0x80) {
+    out += static_cast<char>((value & 0x7f) | 0x80);
+    value >>= 7;
+  }
+  out += static_cast<char>(value);
+}
+
+template <typename T> void put(std::string &out, const T &value) {
+  out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+uint64_t now_us() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+bool write_all(int fd, const std::string &data) {
+  size_t written = 0;
+  while (written < data.size()) {
+    ssize_t n = write(fd, data.data() + written, data.size() - written);
+    if (n <= 0)
+      return false;
+    written += n;
+  }
+  return true;
+}
+
+class Reader {
+public:
+  explicit Reader(const std::string &in) : in_(in) {}
+
+  bool at_end() const { return pos_ == in_.size(); }
+
+  template <typename T> bool get(T &value) {
+    return get_bytes(&value, sizeof(value));
+  }
+  bool get_bytes(void *out, size_t size) {
+    if (in_.size() - pos_ < size)
+      return false;
+    memcpy(out, in_.data() + pos_, size);
+    pos_ += size;
+    return true;
+  }
+  bool get(std::string &str) {
+    uint16_t size;
+    if (!get(size) || in_.size() - pos_ < size)
+      return false;
+    str.assign(in_, pos_, size);
+    pos_ += size;
+    return true;
+  }
+  bool get_varint(uint64_t &value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && pos_ < in_.size(); shift += 7) {
+      uint8_t byte = in_[pos_++];
+      value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if (!(byte & 0x80))
+        return true;
+    }
+    return false;
+  }
+
+private:
+  const std::string &in_;
+  size_t pos_ = 0;
+};
+
+} // namespace
+
+TraceWriter::~TraceWriter() {
+  if (fd_ < 0)
+    return;
+  flush();
+  close(fd_);
+}
+
+bool TraceWriter::open(const char *path, const TraceHeader &header) {
+  fd_ = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd_ < 0)
+    return false;
+
+  put(buffer_, TRACE_MAGIC);
+  put(buffer_, header.root);
+  put(buffer_, header.width);
+  put(buffer_, header.height);
+  put(buffer_, header.resource_id_base);
+  put(buffer_, header.resource_id_mask);
+  put(buffer_, static_cast<uint32_t>(header.atoms.size()));
+  for (const auto &atom : header.atoms) {
+    put(buffer_, atom.second);
+    put(buffer_, static_cast<uint16_t>(atom.first.size()));
+    buffer_ += atom.first;
+  }
+  last_us_ = now_us();
+  flush();
+  return true;
+}
+
+void TraceWriter::record(const xcb_generic_event_t *event) {
+  uint64_t now = now_us();
+  put_varint(buffer_, now - last_us_);
+  last_us_ = now;
+  buffer_.append(reinterpret_cast<const char *>(event), 32);
+}
+
+void TraceWriter::flush() {
+  if (fd_ < 0 || buffer_.empty())
+    return;
+  // A full disk loses events, not the WM.
+  write_all(fd_, buffer_);
+  buffer_.clear();
+}
+
+bool trace_read(const char *path, TraceHeader &header,
+                std::vector<TraceEvent> &events) {
+  int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  std::string data;
+  char buf[65536];
+  ssize_t n;
+  while ((n = read(fd, buf, sizeof(buf))) > 0)
+    data.append(buf, n);
+  close(fd);
+  if (n < 0)
+    return false;
+
+  Reader r(data);
+  uint32_t magic, count;
+  if (!r.get(magic) || magic != TRACE_MAGIC || !r.get(header.root) ||
+      !r.get(header.width) || !r.get(header.height) ||
+      !r.get(header.resource_id_base) || !r.get(header.resource_id_mask) ||
+      !r.get(count))
+    return false;
+  for (uint32_t i = 0; i < count; i++) {
+    std::pair<std::string, xcb_atom_t> atom;
+    if (!r.get(atom.second) || !r.get(atom.first))
+      return false;
+    header.atoms.push_back(atom);
+  }
+
+  uint64_t time_us = 0;
+  while (!r.at_end()) {
+    uint64_t delta;
+    TraceEvent event;
+    if (!r.get_varint(delta) || !r.get_bytes(event.data, sizeof(event.data)))
+      break;
+    time_us += delta;
+    event.time_us = time_us;
+    events.push_back(event);
+  }
+  return true;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include <xcb/xcb.h>
+
+// Event traces (--record FILE): everything the WM received from the X
+// server, in order and with arrival times, for bench/trace_replay to feed
+// to another build. The header carries what is needed to make sense of the
+// events away from the recording server: the root, the range the WM's own
+// resource IDs came from, and the atoms it interned.
+struct TraceHeader {
+  xcb_window_t root = XCB_NONE;
+  uint16_t width = 0;
+  uint16_t height = 0;
+  uint32_t resource_id_base = 0;
+  uint32_t resource_id_mask = 0;
+  std::vector<std::pair<std::string, xcb_atom_t>> atoms;
+};
+
+struct TraceEvent {
+  uint64_t time_us; // since the trace was opened
+  // The event or error as it came off the wire. Only the first 32 bytes
+  // of a GenericEvent are kept.
+  uint8_t data[32];
+};
+
+// Writes a trace. Events are buffered and written once per event batch, so
+// recording costs no system call per event.
+class TraceWriter {
+public:
+  TraceWriter() = default;
+  ~TraceWriter();
+
+  TraceWriter(const TraceWriter &) = delete;
+  TraceWriter &operator=(const TraceWriter &) = delete;
+
+  // Creates path, replacing any previous trace, and writes the header.
+  bool open(const char *path, const TraceHeader &header);
+  bool is_open() const { return fd_ >= 0; }
+
+  void record(const xcb_generic_event_t *event);
+
+  // Writes the buffered events out.
+  void flush();
+
+private:
+  int fd_ = -1;
+  std::string buffer_;
+  uint64_t last_us_ = 0;
+};
+
+// Reads a whole trace. Returns false if path does not hold a trace of this
+// format. A trace cut short (the WM crashed) is read up to its last
+// complete event.
+bool trace_read(const char *path, TraceHeader &header,
+                std::vector<TraceEvent> &events);
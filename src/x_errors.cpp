@@ -0,0 +1,29 @@
+#include "x_errors.h"
+
+namespace {
+
+// Full sequence numbers wrap after 2^32 requests; compare by distance.
+bool before(uint32_t a, uint32_t b) { return static_cast<int32_t>(a - b) < 0; }
+
+} // namespace
+
+void ErrorDispatcher::expect(xcb_void_cookie_t cookie, Expect what,
+                             xcb_window_t window) {
+  pending_.push_back({cookie.sequence, what, window});
+}
+
+void ErrorDispatcher::retire(const xcb_generic_event_t *event) {
+  while (!pending_.empty() &&
+         before(pending_.front().sequence, event->full_sequence))
+    pending_.pop_front();
+}
+
+bool ErrorDispatcher::match(const xcb_generic_error_t *error,
+                            PendingRequest &request) {
+  retire(reinterpret_cast<const xcb_generic_event_t *>(error));
+  if (pending_.empty() || pending_.front().sequence != error->full_sequence)
+    return false;
+  request = pending_.front();
+  pending_.pop_front();
+  return true;
+}
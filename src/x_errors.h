@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <xcb/xcb.h>
+
+// Requests whose failure the WM acts on.
+enum class Expect : uint8_t {
+  SelectRoot,   // SubstructureRedirect on the root: another WM has it
+  Reparent,     // a new client into its frame: the window died meanwhile
+  SelectClient, // a restored client's events: it died in the handover
+};
+
+struct PendingRequest {
+  uint32_t sequence = 0;
+  Expect what = Expect::SelectRoot;
+  xcb_window_t window = XCB_NONE;
+};
+
+// Matches X errors to the requests that caused them, by sequence number.
+// Requests are never sent checked: the ones whose failure matters are
+// registered here when sent, and their errors arrive in the event queue
+// like any other. Any later event means the server got past a request
+// without an error, so registrations are retired in sequence order and
+// the queue stays as short as the requests in flight.
+class ErrorDispatcher {
+public:
+  void expect(xcb_void_cookie_t cookie, Expect what, xcb_window_t window);
+
+  // Drops the requests sent before event, which the server has processed.
+  void retire(const xcb_generic_event_t *event);
+
+  // Takes the registered request error belongs to. Returns false if it is
+  // not one.
+  bool match(const xcb_generic_error_t *error, PendingRequest &request);
+
+private:
+  std::deque<PendingRequest> pending_;
+};
@@ -1,11 +1,20 @@
 #include "xconnection.h"
-#include <iostream>
+#include "log.h"
 
 XConnection::XConnection() {
     conn_ = xcb_connect(nullptr,nullptr);
 
     if(xcb_connection_has_error(conn_)){
-        std::cerr<<"Failed to connect to X server"<<std::endl;
+        LOG_ERROR("Failed to connect to X server");
+    }
+
+}
+
+XConnection::XConnection(int fd) {
+    conn_ = xcb_connect_to_fd(fd,nullptr);
+
+    if(xcb_connection_has_error(conn_)){
+        LOG_ERROR("Failed to set up the X connection on fd %d", fd);
     }
 
 }
@@ -2,9 +2,13 @@
 
 #include<xcb/xcb.h>
 
+// The WM's connection to the X server. Either to $DISPLAY through libxcb,
+// or over an already connected socket: any server speaking the protocol on
+// it will do, such as the fake one the benchmarks run the WM against.
 class XConnection {
     public:
     XConnection();
+    explicit XConnection(int fd);
     ~XConnection();
 
 